@@ -0,0 +1,138 @@
+/*
+ * batch.c - Worker pool of the batch mode of the cache simulator.
+ *
+ * The simulator keeps its state in globals, so the workers are processes
+ * rather than threads: each one is forked with its own copy of the cache
+ * the caller set up, and simulates one trace after the other in it. The
+ * results and the index of the next trace to take live in one shared
+ * anonymous mapping, so a worker that finishes early takes more traces
+ * and nothing is sent back through pipes. A process starts once per
+ * worker instead of once per trace.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "batch.h"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int batch_read_manifest(struct Batch *batch, const char *path)
+{
+    char line[4096];
+    int capacity = 0;
+    FILE *fp = fopen(path, "r");
+
+    memset(batch, 0, sizeof(*batch));
+    if (fp == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (batch->count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            batch->traces = realloc(batch->traces, capacity * sizeof(char *));
+        }
+        batch->traces[batch->count++] = strdup(line);
+    }
+    fclose(fp);
+    return batch->count > 0 ? 0 : -1;
+}
+
+/* Take traces until there is none left */
+static void work(struct Batch *batch,
+                 void (*simulate)(const char *trace, struct BatchResult *result))
+{
+    unsigned long i;
+
+    while ((i = __sync_fetch_and_add(batch->next, 1)) < (unsigned long)batch->count)
+        simulate(batch->traces[i], &batch->results[i]);
+}
+
+int batch_run(struct Batch *batch, int jobs,
+              void (*simulate)(const char *trace, struct BatchResult *result))
+{
+    size_t bytes = batch->count * sizeof(struct BatchResult) + sizeof(unsigned long);
+    void *shared = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    double start = now();
+    int k, started = 0;
+
+    if (shared == MAP_FAILED)
+        return -1;
+    batch->results = shared;
+    batch->next = (unsigned long *)(batch->results + batch->count);
+    if (jobs > batch->count)
+        jobs = batch->count;
+
+    if (jobs <= 1) {
+        work(batch, simulate);
+    }
+    else {
+        fflush(stdout);
+        for (k = 0; k < jobs; k++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                work(batch, simulate);
+                _exit(0);
+            }
+            if (pid > 0)
+                started++;
+        }
+        while (wait(NULL) > 0)
+            ;
+        if (started == 0)
+            return -1;
+    }
+    batch->seconds = now() - start;
+    return 0;
+}
+
+int batch_print_report(const struct Batch *batch, int jobs, int timing)
+{
+    unsigned long long totals[BATCH_COUNTERS] = {0};
+    int i, k, failed = 0;
+
+    for (i = 0; i < batch->count; i++) {
+        const struct BatchResult *result = &batch->results[i];
+        const unsigned long long *counters = result->counters;
+        if (result->status != BATCH_DONE) {
+            printf("trace:%s error:%s\n", batch->traces[i],
+                   result->status == BATCH_FAILED ? "cannot_open" : "not_simulated");
+            failed++;
+            continue;
+        }
+        printf("trace:%s hits:%llu misses:%llu evictions:%llu dirty_bytes_evicted:%llu "
+               "dirty_bytes_active:%llu double_refs:%llu", batch->traces[i], counters[0],
+               counters[1], counters[2], counters[3], counters[4], counters[5]);
+        if (timing)
+            printf(" cycles:%llu amat:%.2f", counters[6], result->amat);
+        printf("\n%s", result->details);
+        for (k = 0; k < BATCH_COUNTERS; k++)
+            totals[k] += counters[k];
+    }
+    printf("batch_traces:%d failed:%d hits:%llu misses:%llu evictions:%llu jobs:%d "
+           "seconds:%.3f accesses_per_second:%.0f\n", batch->count, failed, totals[0],
+           totals[1], totals[2], jobs, batch->seconds,
+           batch->seconds > 0 ? (totals[0] + totals[1]) / batch->seconds : 0.0);
+    return failed;
+}
+
+void batch_free(struct Batch *batch)
+{
+    for (int i = 0; i < batch->count; i++)
+        free(batch->traces[i]);
+    free(batch->traces);
+    if (batch->results != NULL)
+        munmap(batch->results, batch->count * sizeof(struct BatchResult) + sizeof(unsigned long));
+    memset(batch, 0, sizeof(*batch));
+}
@@ -0,0 +1,68 @@
+/*
+ * batch.h - Batch mode of the cache simulator (csim --batch): the traces
+ *     of a manifest simulated with the same options by a pool of workers,
+ *     into one report
+ */
+
+#ifndef CSIM_BATCH_H
+#define CSIM_BATCH_H
+
+/*
+ * The counters of a trace: hits, misses, evictions, dirty bytes evicted,
+ * dirty bytes active, double references, and the cycles of the latency
+ * model (0 without -l), like the STATS reply of the daemon
+ */
+#define BATCH_COUNTERS 7
+
+/* Room for the lines a single run prints after its counters */
+#define BATCH_DETAILS 512
+
+/* Status of a trace */
+#define BATCH_PENDING 0 /* not simulated, its worker died */
+#define BATCH_DONE 1
+#define BATCH_FAILED 2  /* the trace could not be opened */
+
+struct BatchResult {
+    int status;
+    unsigned long long counters[BATCH_COUNTERS];
+    double amat;         /* of the latency model, 0 without -l */
+    char details[BATCH_DETAILS]; /* the split, stride run, victim cache and index lines */
+};
+
+struct Batch {
+    int count;
+    char **traces;               /* in the order of the manifest */
+    struct BatchResult *results; /* one per trace, shared with the workers */
+    unsigned long *next;         /* next trace a worker takes, in the same mapping */
+    double seconds;              /* wall time of batch_run */
+};
+
+/*
+ * batch_read_manifest - Read the traces of a manifest, one path per
+ *     line. Blank lines and lines starting with '#' are skipped. Returns
+ *     0 on success, -1 if the manifest can't be read or has no trace.
+ */
+int batch_read_manifest(struct Batch *batch, const char *path);
+
+/*
+ * batch_run - Simulate every trace of the batch with jobs worker
+ *     processes (1 simulates them in this process). Each worker takes the
+ *     next trace nobody has taken yet and calls simulate on it, which
+ *     fills its result. The workers are forked after the caller has set
+ *     up its cache, so each one starts from a copy of it. Returns 0 on
+ *     success, -1 if the workers could not be started.
+ */
+int batch_run(struct Batch *batch, int jobs,
+              void (*simulate)(const char *trace, struct BatchResult *result));
+
+/*
+ * batch_print_report - Print a line with the counters of each trace, in
+ *     the order of the manifest, followed by its details, then the totals
+ *     and the throughput, with the cycles and AMAT of the latency model if
+ *     timing is set. Returns the number of traces that were not simulated.
+ */
+int batch_print_report(const struct Batch *batch, int jobs, int timing);
+
+void batch_free(struct Batch *batch);
+
+#endif /* CSIM_BATCH_H */
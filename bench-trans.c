@@ -0,0 +1,114 @@
+/*
+ * bench-trans.c - Measure the memory bandwidth of trans_parallel on a large
+ *     matrix with 1 thread, 2 threads, ... up to every online core, and
+ *     print the scaling.
+ *
+ * A GB/s figure counts the bytes read from A and written to B. Each
+ * thread count gets a fresh B first touched for that count (see
+ * trans_parallel_alloc) and keeps the best of several runs. The first
+ * touch also starts the workers of the pool the count needs, so the
+ * timed runs do not include creating threads.
+ */
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include "trans-parallel.h"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-M <cols>] [-N <rows>] [-t <threads>] [-r <runs>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h           Print this help message.\n");
+    printf("  -M <cols>    Columns of A (default 8192).\n");
+    printf("  -N <rows>    Rows of A (default 8192).\n");
+    printf("  -t <threads> Largest number of threads (default: online cores).\n");
+    printf("  -r <runs>    Runs per thread count, the best one is kept (default 3).\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int M = 8192, N = 8192, runs = 3;
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+    long i;
+    int c;
+
+    while ((c = getopt(argc, argv, "hM:N:t:r:")) != -1) {
+        switch (c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (M <= 0 || N <= 0 || max_threads <= 0 || runs <= 0) {
+        usage(argv);
+        exit(1);
+    }
+
+    double bytes = 2.0 * M * N * sizeof(int);
+    int *A = trans_parallel_alloc(N, M, max_threads);
+    if (A == NULL) {
+        printf("Error: Can't allocate two %dx%d matrices\n", N, M);
+        exit(1);
+    }
+    for (i = 0; i < (long)M * N; i++)
+        A[i] = i;
+
+    printf("Transposing a %dx%d matrix of ints (%.0f MB each way), best of %d runs\n",
+           N, M, bytes / 2 / (1 << 20), runs);
+    printf("%8s%10s%10s%10s\n", "Threads", "Seconds", "GB/s", "Speedup");
+    for (int threads = 1; threads <= max_threads; threads++) {
+        int *B = trans_parallel_alloc(M, N, threads);
+        double best = 0;
+        if (B == NULL) {
+            printf("Error: Can't allocate a %dx%d matrix\n", M, N);
+            exit(1);
+        }
+        for (int run = 0; run < runs; run++) {
+            double start = now();
+            trans_parallel(M, N, A, B, threads);
+            double elapsed = now() - start;
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+        /* spot check a column of A against the matching row of B */
+        for (i = 0; i < N; i += 1 + N / 64) {
+            long j = (i * 7) % M;
+            if (B[j * N + i] != A[i * M + j]) {
+                printf("Error: B[%ld][%ld] is not A[%ld][%ld]\n", j, i, i, j);
+                exit(1);
+            }
+        }
+        if (threads == 1)
+            base = best;
+        printf("%8d%10.4f%10.2f%10.2f\n", threads, best, bytes / best / 1e9, base / best);
+        trans_parallel_free(B, M, N);
+    }
+    trans_parallel_free(A, N, M);
+    return 0;
+}
@@ -21,16 +21,31 @@ void printSummary(int hits,
 		  int dirty_active,
 		  int double_accesses)
 {
-    printf("hits:%d "
-	   "misses:%d "
-	   "evictions:%d "
-	   "dirty_bytes_evicted:%d "
-	   "dirty_bytes_active:%d "
-	   "double_refs:%d\n",
+    printSummary64(hits, misses, evictions, 
+		   dirty_evicted, dirty_active, double_accesses);
+}
+
+/* 
+ * printSummary64 - printSummary with 64-bit counters. The output format
+ *                  is the same, so the autograders read it unchanged.
+ */
+void printSummary64(unsigned long long hits,
+		    unsigned long long misses,
+		    unsigned long long evictions,
+		    unsigned long long dirty_evicted,
+		    unsigned long long dirty_active,
+		    unsigned long long double_accesses)
+{
+    printf("hits:%llu "
+	   "misses:%llu "
+	   "evictions:%llu "
+	   "dirty_bytes_evicted:%llu "
+	   "dirty_bytes_active:%llu "
+	   "double_refs:%llu\n",
 	   hits, misses, evictions, dirty_evicted, dirty_active, double_accesses);
     FILE* output_fp = fopen(".csim_results", "w");
     assert(output_fp);
-    fprintf(output_fp, "%d %d %d %d %d %d\n",
+    fprintf(output_fp, "%llu %llu %llu %llu %llu %llu\n",
 	    hits,
 	    misses,
 	    evictions,
@@ -40,6 +55,39 @@ void printSummary(int hits,
     fclose(output_fp);
 }
 
+/* 
+ * printTimingSummary - Summarize the latency model of the cache simulator.
+ *                      The results go on the second line of .csim_results so
+ *                      that readers of the first line are not affected.
+ */
+void printTimingSummary(unsigned long long cycles,
+			double amat,
+			double bandwidth_util)
+{
+    printf("cycles:%llu amat:%.2f bandwidth_util:%.3f\n",
+	   cycles, amat, bandwidth_util);
+    FILE* output_fp = fopen(".csim_results", "a");
+    assert(output_fp);
+    fprintf(output_fp, "%llu %.2f %.3f\n", cycles, amat, bandwidth_util);
+    fclose(output_fp);
+}
+
+/* 
+ * hashBytes - FNV-1a. It is not a cryptographic hash, the cache keys only
+ *             have to change when the bytes do
+ */
+unsigned long long hashBytes(const void *data, unsigned long length,
+			     unsigned long long hash)
+{
+    const unsigned char *bytes = data;
+    unsigned long i;
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 /* 
  * initMatrix - Initialize the given matrix 
  */
@@ -91,10 +139,23 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
                            char* desc)
 {
     func_list[func_counter].func_ptr = trans;
+    func_list[func_counter].kernel = NULL;
     func_list[func_counter].description = desc;
     func_list[func_counter].correct = 0;
     func_list[func_counter].num_hits = 0;
     func_list[func_counter].num_misses = 0;
     func_list[func_counter].num_evictions =0;
+    func_list[func_counter].num_cycles = 0;
+    func_list[func_counter].amat = 0;
     func_counter++;
 }
+
+/* 
+ * registerKernel - Add the given kernel to the list of functions to be
+ *     tested. It is traced and evaluated like a transpose function.
+ */
+void registerKernel(const kernel_t* kernel)
+{
+    registerTransFunction(NULL, kernel->description);
+    func_list[func_counter - 1].kernel = kernel;
+}
@@ -7,13 +7,53 @@
 
 #define MAX_TRANS_FUNCS 100
 
+/*
+ * Kernels other than the transpose (see kernels.c). A kernel describes
+ * its operands, which tracegen allocates on the heap, initializes, and
+ * checks against the kernel's reference implementation after the traced
+ * run. M and N are the -M and -N of test-trans; each kernel says what
+ * they mean for its operands in its shape function.
+ */
+#define MAX_OPERANDS 4
+
+typedef enum {
+  ELEM_CHAR, ELEM_SHORT, ELEM_INT, ELEM_LONG, ELEM_FLOAT, ELEM_DOUBLE
+} elem_type_t;
+
+#define OPERAND_IN  1 /* read by the kernel, filled with random data */
+#define OPERAND_OUT 2 /* written by the kernel, checked after the run */
+
+typedef struct operand {
+  const char* name;
+  elem_type_t type;
+  int role;              /* OPERAND_IN and/or OPERAND_OUT */
+  int rows, cols;        /* set by the kernel's shape function */
+} operand_t;
+
+typedef struct kernel {
+  const char* name;
+  char* description;
+  int num_operands;
+  operand_t operands[MAX_OPERANDS];
+  /* Set the rows and cols of every operand for -M M -N N */
+  void (*shape)(int M, int N, operand_t ops[]);
+  /* Fill the inputs, NULL for random elements */
+  void (*init)(int M, int N, void* ops[]);
+  /* The traced kernel and the implementation it is checked against */
+  void (*run)(int M, int N, void* ops[]);
+  void (*reference)(int M, int N, void* ops[]);
+} kernel_t;
+
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
+  const kernel_t* kernel; /* instead of func_ptr for the other kernels */
   char* description;
   char correct;
-  unsigned int num_hits;
-  unsigned int num_misses;
-  unsigned int num_evictions;
+  unsigned long long num_hits;
+  unsigned long long num_misses;
+  unsigned long long num_evictions;
+  unsigned long long num_cycles; /* estimated by the csim latency model (-l) */
+  double amat;
 } trans_func_t;
 
 /* 
@@ -27,6 +67,34 @@ void printSummary(int hits,  /* number of  hits */
 		  int dirty_active, /* number of dirty bytes active */
 		  int double_accesses); /* number of double accesses */
 
+/*
+ * printSummary64 - Same as printSummary with 64-bit counters, for traces
+ * long enough to overflow an int. The output has the same format.
+ */
+void printSummary64(unsigned long long hits,
+		    unsigned long long misses,
+		    unsigned long long evictions,
+		    unsigned long long dirty_evicted,
+		    unsigned long long dirty_active,
+		    unsigned long long double_accesses);
+
+/*
+ * printTimingSummary - Report the estimated cycles, average memory access
+ * time and memory bandwidth utilization of the csim latency model. Must be
+ * called after printSummary, it adds a second line to the results file.
+ */
+void printTimingSummary(unsigned long long cycles, /* estimated cycles */
+			double amat, /* average memory access time in cycles */
+			double bandwidth_util); /* fraction of the memory bandwidth used */
+
+/*
+ * hashBytes - 64-bit FNV-1a hash of a buffer, continuing from hash (pass
+ * HASH_SEED to start). Used to key the cached traces and results.
+ */
+#define HASH_SEED 0xcbf29ce484222325ULL
+unsigned long long hashBytes(const void *data, unsigned long length,
+			     unsigned long long hash);
+
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 
@@ -37,4 +105,7 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* Add the given kernel to the function list, after the transposes */
+void registerKernel(const kernel_t* kernel);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,94 @@
+/* 
+ * csim-kernel.h - Template of a cache simulator kernel specialized for
+ *     one geometry. Define KERNEL_S, KERNEL_E and KERNEL_B, then include
+ *     this file to get access_sS_EE_bB(), dirty_lines_sS_EE_bB() and
+ *     reset_sS_EE_bB().
+ *
+ * The cache is a static array, the masks are constants and the way loops
+ * have a constant trip count, so the compiler unrolls them. The ways of a
+ * set are kept in MRU to LRU order, which is cheap for the small E the
+ * kernels are generated for. The results are the same as the generic
+ * engine in csim.c with modulo indexing and no victim cache.
+ *
+ * This file is included once per geometry by the generated csim-kernels.c.
+ */
+#include <string.h>
+#include "csim.h"
+
+#define KERNEL_PASTE(name, s, e, b) name##_s##s##_E##e##_b##b
+#define KERNEL_NAME(name, s, e, b) KERNEL_PASTE(name, s, e, b)
+#define KERNEL(name) KERNEL_NAME(name, KERNEL_S, KERNEL_E, KERNEL_B)
+
+static unsigned long KERNEL(tags)[1 << KERNEL_S][KERNEL_E];
+static unsigned char KERNEL(dirty)[1 << KERNEL_S][KERNEL_E];
+static unsigned char KERNEL(size)[1 << KERNEL_S];
+
+int KERNEL(access)(struct Cache *cache, char operation, unsigned long address)
+{
+    unsigned long block = address >> KERNEL_B;
+    unsigned long set = block & ((1UL << KERNEL_S) - 1);
+    unsigned long tag = block >> KERNEL_S;
+    unsigned long *tags = KERNEL(tags)[set];
+    unsigned char *dirty = KERNEL(dirty)[set];
+    int size = KERNEL(size)[set];
+    int way, last, outcome;
+
+    for (way = 0; way < KERNEL_E; way++) {
+        if (way < size && tags[way] == tag) {
+            int dirty_bit = dirty[way] | (operation == 'S');
+            hit++;
+            if (way == 0)
+                double_refs++;
+            for (; way > 0; way--) {
+                tags[way] = tags[way - 1];
+                dirty[way] = dirty[way - 1];
+            }
+            tags[0] = tag;
+            dirty[0] = dirty_bit;
+            return ACCESS_HIT;
+        }
+    }
+
+    miss++;
+    outcome = ACCESS_MISS;
+    last = size;
+    if (size == KERNEL_E) {
+        last = KERNEL_E - 1;
+        outcome |= ACCESS_EVICT;
+        evict++;
+        if (dirty[last]) {
+            dirty_bytes_evicted++;
+            outcome |= ACCESS_DIRTY_EVICT;
+        }
+    }
+    else {
+        KERNEL(size)[set] = size + 1;
+    }
+    for (way = last; way > 0; way--) {
+        tags[way] = tags[way - 1];
+        dirty[way] = dirty[way - 1];
+    }
+    tags[0] = tag;
+    dirty[0] = (operation == 'S');
+    return outcome;
+}
+
+int KERNEL(dirty_lines)(void)
+{
+    int set, way, lines = 0;
+
+    for (set = 0; set < (1 << KERNEL_S); set++)
+        for (way = 0; way < KERNEL(size)[set]; way++)
+            lines += KERNEL(dirty)[set][way];
+    return lines;
+}
+
+/* Empty every set, the tags and dirty bits of a way are only read below its size */
+void KERNEL(reset)(void)
+{
+    memset(KERNEL(size), 0, sizeof(KERNEL(size)));
+}
+
+#undef KERNEL_S
+#undef KERNEL_E
+#undef KERNEL_B
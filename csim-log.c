@@ -0,0 +1,129 @@
+/*
+ * csim-log.c - Decode the binary event log written by csim -v.
+ *
+ * Every access is printed on one line, in the style of the verbose mode
+ * of the reference simulator:
+ *
+ *     L 602100 set:8 miss eviction victim_tag:181 dirty_writeback
+ *
+ * With -c only the totals are printed, which must match the summary of
+ * the run that wrote the log.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "csim.h"
+#include "csim-log.h"
+
+#define READ_RECORDS 65536
+
+static const char *index_names[] = {"modulo", "xor", "prime", "skew"};
+
+static void print_record(const struct LogRecord *record)
+{
+    printf("%c %lx set:%u", record->walk ? 'W' : record->operation,
+           record->address, record->set);
+    if (!(record->outcome & ACCESS_MISS)) {
+        printf(" hit");
+    } else {
+        printf(" miss");
+        if (record->outcome & ACCESS_VICTIM_HIT)
+            printf(" victim_hit");
+        if (record->outcome & ACCESS_EVICT)
+            printf(" eviction victim_tag:%lx", record->victim_tag);
+        if (record->outcome & ACCESS_DIRTY_EVICT)
+            printf(" dirty_writeback");
+    }
+    if (record->tenant != 0)
+        printf(" tenant:%d", record->tenant);
+    putchar('\n');
+}
+
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-hc] [<log>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h     Print this help message.\n");
+    printf("  -c     Only print the totals.\n");
+    printf("  <log>  Event log written by csim -v (default %s).\n", LOG_DEFAULT_PATH);
+}
+
+int main(int argc, char *argv[])
+{
+    struct LogHeader header;
+    static struct LogRecord records[READ_RECORDS];
+    unsigned long long hits = 0, misses = 0, evictions = 0, writebacks = 0;
+    unsigned long long walk_hits = 0, walk_misses = 0, walk_evictions = 0;
+    const char *path = LOG_DEFAULT_PATH;
+    int counts_only = 0;
+    size_t n, i;
+    int c;
+
+    while ((c = getopt(argc, argv, "hc")) != -1) {
+        switch (c) {
+        case 'c':
+            counts_only = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+
+    FILE *log_fp = fopen(path, "rb");
+    if (!log_fp) {
+        printf("Error: Can't open %s\n", path);
+        exit(1);
+    }
+    if (fread(&header, sizeof(header), 1, log_fp) != 1 ||
+        memcmp(header.magic, LOG_MAGIC, sizeof(header.magic)) != 0) {
+        printf("Error: %s is not a csim event log\n", path);
+        exit(1);
+    }
+    if (!counts_only)
+        printf("s:%d E:%d b:%d index:%s\n", header.s, header.E, header.b,
+               header.index >= 0 && header.index < 4 ? index_names[header.index] : "?");
+
+    while ((n = fread(records, sizeof(struct LogRecord), READ_RECORDS, log_fp)) > 0) {
+        for (i = 0; i < n; i++) {
+            /* page-walk loads have totals of their own, as on csim's TLB
+               line, but their dirty write backs are write backs all the same */
+            if (records[i].walk) {
+                if (records[i].outcome & ACCESS_MISS)
+                    walk_misses++;
+                else
+                    walk_hits++;
+                if (records[i].outcome & ACCESS_EVICT)
+                    walk_evictions++;
+            } else {
+                if (records[i].outcome & ACCESS_MISS)
+                    misses++;
+                else
+                    hits++;
+                if (records[i].outcome & ACCESS_EVICT)
+                    evictions++;
+            }
+            if (records[i].outcome & ACCESS_DIRTY_EVICT)
+                writebacks++;
+            if (!counts_only)
+                print_record(&records[i]);
+        }
+    }
+    fclose(log_fp);
+    if (counts_only) {
+        printf("hits:%llu misses:%llu evictions:%llu dirty_writebacks:%llu",
+               hits, misses, evictions, writebacks);
+        if (walk_hits + walk_misses > 0)
+            printf(" walk_hits:%llu walk_misses:%llu walk_evictions:%llu",
+                   walk_hits, walk_misses, walk_evictions);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * csim-log.h - Format of the binary event log written by csim -v
+ *
+ * The log is a LogHeader followed by one LogRecord per block access, in
+ * the order of the accesses. Integers are in the native byte order.
+ */
+
+#ifndef CSIM_LOG_H
+#define CSIM_LOG_H
+
+#define LOG_MAGIC "CSIMLOG1"
+#define LOG_DEFAULT_PATH ".csim_events"
+
+struct LogHeader {
+    char magic[8];
+    int s, E, b;
+    int index;   /* set index function, 0 is modulo (see csim --index) */
+};
+
+struct LogRecord {
+    unsigned long address;
+    unsigned long victim_tag; /* tag of the evicted line, if outcome has ACCESS_EVICT */
+    unsigned int set;         /* set the block maps to (the filled set of a skewed cache) */
+    char operation;           /* 'L' or 'S', a modify is logged as both */
+    unsigned char outcome;    /* ACCESS_* flags of csim.h */
+    unsigned char tenant;
+    unsigned char walk;       /* a page-walk load of the TLB model */
+};
+
+#endif /* CSIM_LOG_H */
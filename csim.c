@@ -1,242 +1,2290 @@
 #include "cachelab.h"
+#include "csim.h"
+#include "tlb.h"
+#include "dram.h"
+#include "server.h"
+#include "batch.h"
+#include "csim-log.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 /*
- *each cache has 2^s sets which are linked like linked list.
- *each set has E lines which are linked like linked list.
- *each line has a valid bit and a tag and an address
- *a line in cache is the fundamental part of the cache
+ *each cache has 2^s sets stored in an array.
+ *each set has E lines whose tags are stored next to each other, ordered by an LRU list.
+ *each line has a tag and a dirty bit, a line in cache is the fundamental part of the cache
  *the address has tag, set index (don't need block offset)
 */
 
 /*
  *define global variables to calculate or return in the later functions
  */
-int hit = 0;
-int miss = 0;
-int evict = 0;
-int dirty_bytes_evicted = 0;
-int dirty_bytes_active = 0;
-int double_refs = 0;
+unsigned long long hit = 0;
+unsigned long long miss = 0;
+unsigned long long evict = 0;
+unsigned long long dirty_bytes_evicted = 0; //counted in lines, printed in bytes
+unsigned long long dirty_bytes_active = 0;
+unsigned long long double_refs = 0;
 int s,E,b,t;
 const int memory_address = sizeof(long)*8;
 int h_flag = 0;
 int v_flag = 0;
+int z_flag = 0;
+unsigned long long split_accesses = 0; //accesses that touched more than one block (only counted with -z)
+unsigned long long split_blocks = 0; //blocks touched by those split accesses
 char L,S,M;
 
+/*
+ *latency model (-l). Latencies are in cycles and the memory bandwidth is in bytes per cycle.
+ *mshr_count = 0 models a blocking cache: every miss stalls until its block has arrived.
+ */
+int l_flag = 0;
+int hit_latency = 4;
+int memory_latency = 100;
+int memory_bandwidth = 16;
+int mshr_count = 0;
+long interval = 0; //print a timing line every "interval" block accesses, 0 turns it off
+
+struct Timing
+{
+    unsigned long long now; //cycle at which the next access issues
+    unsigned long long last_done; //cycle at which the last outstanding miss completes
+    unsigned long long bus_free; //cycle at which the memory bus is free again
+    unsigned long long *mshr; //completion cycle of each miss status holding register
+    unsigned long long accesses;
+    unsigned long long latency_sum; //sum of the latencies seen by every access, used for the AMAT
+    unsigned long long bytes; //bytes moved over the memory bus (fills and dirty writebacks)
+    //values at the start of the current interval
+    unsigned long long interval_accesses, interval_cycles, interval_latency_sum, interval_bytes;
+    long interval_count;
+    unsigned long long start; //cycle of the last reset of the daemon, the cycles are counted from it
+};
+struct Timing timing;
+
+/*
+ *optional small fully associative cache next to the main cache (Jouppi, 1990), kept as an LRU list.
+ *a victim cache receives every line evicted from the main cache and swaps a line back on a hit,
+ *a miss cache keeps a (clean) copy of every block the main cache missed on.
+ *the main cache hit/miss/eviction counters are not changed by either of them.
+ */
+#define VICTIM_NONE 0
+#define VICTIM_CACHE 1
+#define MISS_CACHE 2
+
+struct VictimLine
+{
+    unsigned long block; //block address, the cache is fully associative so there is no set index
+    int dirty_bit;
+    struct VictimLine *next;
+};
+
+struct VictimCache
+{
+    int kind;
+    int capacity;
+    int size;
+    int latency; //extra cycles over a hit for a miss served by this cache
+    struct VictimLine *head_line; //MRU node, the last node is the LRU node
+    unsigned long long hits;
+    unsigned long long swaps; //victim hits that sent a line from the main cache back in exchange
+    unsigned long long evictions;
+};
+struct VictimCache victim = {VICTIM_NONE, 0, 0, 1, NULL, 0, 0, 0};
+
+//optional TLB fed by the same block accesses (--tlb), see tlb.c
+struct TLB tlb = {.page_shift = PAGE_SHIFT_4K};
+
+//optional DRAM back end fed by the misses and dirty write backs (--dram), see dram.c
+struct DRAM dram = {.ranks = 1, .banks = 8, .row_bytes = 8192,
+                    .order = {DRAM_ROW, DRAM_RANK, DRAM_BANK, DRAM_CHANNEL, DRAM_COLUMN},
+                    .policy = DRAM_OPEN_PAGE, .depth = 16, .t_cas = 14, .t_rcd = 14, .t_rp = 14, .t_burst = 4};
+unsigned long writeback_block; //block of the last dirty line written back to memory
+
+/*
+ *multi-tenant mode: the traces of several tenants (-t is tenant 0, --tenant adds the others) are interleaved
+ *into the one cache by a schedule (--schedule): round-robin one record at a time, time slices of n records,
+ *or by timestamp, in which case every record starts with a decimal timestamp.
+ *--ways gives CAT-style way masks: a tenant hits in any way but only fills the ways of its mask.
+ */
+#define MAX_TENANTS 8
+#define SCHEDULE_RR 0
+#define SCHEDULE_SLICE 1
+#define SCHEDULE_TIMESTAMP 2
+
+struct Tenant
+{
+    char* name;
+    FILE* trace;
+    unsigned long long way_mask; //ways it may fill
+    int done; //the trace is exhausted
+    //the next record of its trace
+    unsigned long long timestamp;
+    char operation;
+    unsigned long address;
+    int size;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long lost; //its lines evicted by the misses of other tenants
+};
+struct Tenant tenants[MAX_TENANTS];
+int tenant_count = 0;
+int current_tenant = 0; //tenant of the record being simulated
+int schedule = SCHEDULE_RR;
+long slice = 1; //records per turn
+int partitioned = 0;
+
+
+/*
+ *define the data structure of a set in cache.
+ *the tags of a set are stored contiguously so a lookup compares several of them at a time (find_way).
+ *tags are stored in 32 bits while every tag seen so far fits, which is the case for the addresses
+ *of ordinary traces; the first wider tag switches the whole cache to 64-bit tags (widen_tags),
+ *so high addresses never alias and memory only grows when they actually show up.
+ *the valid lines always occupy ways 0..size-1, because a line is never invalidated once it is filled.
+ *the LRU order is a doubly linked list threaded through the ways by index: "mru" is the head node
+ *and "lru" the last node, so a hit moves its way to the head and a miss reuses the last way in O(1).
+ *a set with very many ways (fully associative caches) also gets a hash table from tag to way.
+ */
+
+struct Set
+{
+    int E;
+    int index; //set index, needed to rebuild the block address of an evicted line
+    int size; //number of valid lines
+    int mru; //way of the head node (MRU), -1 when the set is empty
+    int lru; //way of the last node (LRU)
+    unsigned *tags32; //the tags while they fit in 32 bits, NULL once widened
+    unsigned long *tags64; //the tags after widening, NULL before
+    unsigned char *dirty_bits;
+    int *newer; //way of the previous node in the LRU list, -1 for the head
+    int *older; //way of the next node in the LRU list, -1 for the last node
+    int *hash; //open addressing table of way + 1 (0 is an empty slot), NULL unless E >= HASH_MIN_WAYS
+    int hash_mask;
+    unsigned char *owners; //tenant that filled each way, NULL with a single tenant
+    unsigned long long valid; //valid ways, only kept with way partitioning, where they are not 0..size-1
+};
+
+/*
+ *the cache is an array of sets. Their tags, dirty bits and LRU links each live in one allocation
+ *of S * E entries, set i owning the entries i*E .. i*E+E-1.
+ */
+
+struct Cache
+{
+    int S;
+    struct Set *sets;
+    unsigned *tags32;
+    unsigned long *tags64;
+    unsigned char *dirty_bits;
+    int *links; //newer and older links of every way
+    int *hash; //hash tables of every set, only for very large E
+    unsigned char *owners; //owner tenant of every way, only with several tenants
+    struct SkewLine *skew_lines; //E banks of S lines, only used by the skewed-associative cache
+};
+
+//from this many ways on, a set finds its tags with a hash table instead of comparing them all
+#define HASH_MIN_WAYS 256
+
+/*
+ *set index functions (--index). Each one maps a block number to a set index and the tag stored in the line,
+ *and block_of rebuilds the block number from the two (the victim cache needs it).
+ *modulo is the plain low-order bits, xor folds every s-bit chunk of the tag into them,
+ *prime takes the block number modulo the largest prime number of sets not above 2^s.
+ */
+#define INDEX_MODULO 0
+#define INDEX_XOR 1
+#define INDEX_PRIME 2
+#define INDEX_SKEW 3
+int index_kind = INDEX_MODULO;
+const char* index_names[] = {"modulo", "xor", "prime", "skew"};
+int prime_sets = 1;
+
+/*
+ *a line of the skewed-associative cache (Seznec, 1993). Way w of a block lives in set skew_index(block, w)
+ *of bank w, so a block has E candidate lines in E different sets and LRU picks among them.
+ *the line keeps the whole block number because the set index alone no longer determines it.
+ */
+struct SkewLine
+{
+    int valid;
+    int dirty_bit;
+    unsigned long block;
+    unsigned long last_used;
+};
+unsigned long skew_clock = 0;
+
+//xor all the s-bit chunks of x together
+unsigned long fold(unsigned long x)
+{
+    unsigned long folded = 0;
+    if(s == 0)
+        return 0;
+    while(x != 0){
+        folded ^= x & ((1UL << s) - 1);
+        x >>= s;
+    }
+    return folded;
+}
+
+int index_modulo(unsigned long block, unsigned long *tag)
+{
+    *tag = block >> s;
+    return block & ((1UL << s) - 1);
+}
+
+int index_xor(unsigned long block, unsigned long *tag)
+{
+    *tag = block >> s;
+    return (block ^ fold(*tag)) & ((1UL << s) - 1);
+}
+
+int index_prime(unsigned long block, unsigned long *tag)
+{
+    *tag = block / prime_sets;
+    return block % prime_sets;
+}
+
+unsigned long block_of(unsigned long tag, int set_index)
+{
+    switch(index_kind){
+        case INDEX_XOR:
+            return (tag << s) | ((set_index ^ fold(tag)) & ((1UL << s) - 1));
+        case INDEX_PRIME:
+            return tag * prime_sets + set_index;
+        default:
+            return (tag << s) | set_index;
+    }
+}
+
+//set of bank "way" for a block: way 0 uses the plain index, the others xor in a different multiplicative hash of the tag
+int skew_index(unsigned long block, int way)
+{
+    if(s == 0)
+        return 0;
+    unsigned long tag = block >> s;
+    unsigned long hash = way == 0 ? 0 : (tag * (2 * way + 1) * 0x9E3779B97F4A7C15UL) >> (memory_address - s);
+    return (block ^ hash) & ((1UL << s) - 1);
+}
+
+//selected once at startup so the lookup does not test the index kind on every access
+int (*set_index_of)(unsigned long block, unsigned long *tag) = index_modulo;
+
+//the number of sets is 2^s, except for prime-modulo indexing
+int set_count(int s)
+{
+    if(index_kind != INDEX_PRIME)
+        return 1 << s;
+    for(int n = 1 << s; n > 2; --n){
+        int prime = 1;
+        for(int d = 2; d * d <= n && prime; ++d)
+            if(n % d == 0)
+                prime = 0;
+        if(prime)
+            return n;
+    }
+    return s > 0 ? 2 : 1;
+}
+
+
+//initialize a set with the capacity of E number of lines, its arrays are the slice "index" of the cache arrays
+void initialize_set(struct Cache *cache, struct Set *set, int E, int index)
+{
+    size_t first = (size_t)index * E;
+    set->E = E;
+    set->index = index;
+    set->size = 0;
+    set->mru = -1;
+    set->lru = -1;
+    set->tags32 = cache->tags32 + first;
+    set->tags64 = NULL;
+    set->dirty_bits = cache->dirty_bits + first;
+    set->newer = cache->links + 2 * first;
+    set->older = set->newer + E;
+    set->hash = NULL;
+    set->hash_mask = 0;
+    set->owners = cache->owners != NULL ? cache->owners + first : NULL;
+    set->valid = 0;
+    if(cache->hash != NULL){
+        int slots = 1;
+        while(slots < 2 * E)
+            slots <<= 1;
+        set->hash = cache->hash + (size_t)index * slots;
+        set->hash_mask = slots - 1;
+    }
+}
+
+//initialize cache with 2^s empty sets (a prime number of sets with --index prime)
+
+void initialize_cache(struct Cache* cache, int s, int E)
+    {
+        cache -> S = set_count(s);
+        cache -> sets = NULL;
+        cache -> tags32 = NULL;
+        cache -> tags64 = NULL;
+        cache -> dirty_bits = NULL;
+        cache -> links = NULL;
+        cache -> hash = NULL;
+        cache -> owners = NULL;
+        cache -> skew_lines = NULL;
+        if(index_kind == INDEX_SKEW){
+            //the skewed cache keeps its lines in E banks, it does not use the sets
+            cache -> skew_lines = calloc((size_t)E * cache -> S, sizeof(struct SkewLine));
+            return;
+        }
+        size_t lines = (size_t)cache -> S * E;
+        cache -> sets = malloc(cache -> S * sizeof(struct Set));
+        cache -> tags32 = malloc(lines * sizeof(unsigned));
+        cache -> dirty_bits = malloc(lines);
+        cache -> links = malloc(2 * lines * sizeof(int));
+        if(E >= HASH_MIN_WAYS){
+            int slots = 1;
+            while(slots < 2 * E)
+                slots <<= 1;
+            cache -> hash = calloc((size_t)cache -> S * slots, sizeof(int));
+        }
+        if(tenant_count > 1)
+            cache -> owners = calloc(lines, 1);
+        for(int i = 0; i < cache -> S; ++i)
+            initialize_set(cache, &cache -> sets[i], E, i);
+    }
+
+//empty the cache for the next trace of a batch: the sets are cleared in place in O(sets) and every array is reused.
+//the tags and dirty bits of a way are only read below the size of its set, the hash tables are cleared in bulk.
+void reset_cache(struct Cache* cache, int E)
+{
+    if(cache -> skew_lines != NULL)
+        memset(cache -> skew_lines, 0, (size_t)E * cache -> S * sizeof(struct SkewLine));
+    for(int i = 0; cache -> sets != NULL && i < cache -> S; ++i){
+        struct Set* set = &cache -> sets[i];
+        set -> size = 0;
+        set -> mru = -1;
+        set -> lru = -1;
+        set -> valid = 0;
+    }
+    if(cache -> hash != NULL)
+        memset(cache -> hash, 0, (size_t)cache -> S * (cache -> sets[0].hash_mask + 1) * sizeof(int));
+    while(victim.head_line != NULL){
+        struct VictimLine* next_line = victim.head_line -> next;
+        free(victim.head_line);
+        victim.head_line = next_line;
+    }
+    victim.size = 0;
+    skew_clock = 0;
+}
+
+//number of valid lines in a set. Will use it to determine when the set is full
+
+int set_size(struct Set *set)
+{
+    return set -> size;
+}
+
+//tag stored in a way of a set, whatever the width of the tag array
+static inline unsigned long tag_of(struct Set *set, int way)
+{
+    return set -> tags64 != NULL ? set -> tags64[way] : set -> tags32[way];
+}
+
+//switch the whole cache to 64-bit tags, the first time a tag does not fit in 32 bits
+void widen_tags(struct Cache* cache)
+{
+    size_t lines = (size_t)cache -> S * E;
+    cache -> tags64 = malloc(lines * sizeof(unsigned long));
+    for(size_t i = 0; i < lines; ++i)
+        cache -> tags64[i] = cache -> tags32[i];
+    free(cache -> tags32);
+    cache -> tags32 = NULL;
+    for(int i = 0; i < cache -> S; ++i){
+        cache -> sets[i].tags32 = NULL;
+        cache -> sets[i].tags64 = cache -> tags64 + (size_t)i * E;
+    }
+}
+
+//home slot of a tag in the hash table of a set
+static inline int hash_home(struct Set *set, unsigned long tag)
+{
+    return (int)(((tag * 0x9E3779B97F4A7C15UL) >> 32) & set -> hash_mask);
+}
+
+//slot of the hash table where "tag" is, or the empty slot where it would go
+int hash_slot(struct Set *set, unsigned long tag)
+{
+    int slot = hash_home(set, tag);
+    while(set -> hash[slot] != 0 && tag_of(set, set -> hash[slot] - 1) != tag)
+        slot = (slot + 1) & set -> hash_mask;
+    return slot;
+}
+
+//remove a tag from the hash table, moving back the entries that probed past its slot (linear probing deletion)
+void hash_remove(struct Set *set, unsigned long tag)
+{
+    int hole = hash_slot(set, tag);
+    int slot = hole;
+    set -> hash[hole] = 0;
+    while(1){
+        slot = (slot + 1) & set -> hash_mask;
+        if(set -> hash[slot] == 0)
+            return;
+        int home = hash_home(set, tag_of(set, set -> hash[slot] - 1));
+        //the entry can move to the hole only if its home slot is not between the hole and its slot
+        if(((slot - home) & set -> hash_mask) >= ((slot - hole) & set -> hash_mask)){
+            set -> hash[hole] = set -> hash[slot];
+            set -> hash[slot] = 0;
+            hole = slot;
+        }
+    }
+}
+
+/*
+ *find the way holding "tag" among the first n 32-bit tags of a set, -1 if it is not there.
+ *AVX2 compares 16 tags per iteration and SSE2 (always there on x86-64) compares 16 as four groups of 4;
+ *the remaining tags and other targets use the scalar loop.
+ */
+int find_way(const unsigned *tags, int n, unsigned tag)
+{
+    int way = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32((int)tag);
+    for(; way + 16 <= n; way += 16){
+        __m256i low = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags + way)), key);
+        __m256i high = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags + way + 8)), key);
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(low)) |
+                        ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8);
+        if(mask)
+            return way + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32((int)tag);
+    for(; way + 16 <= n; way += 16){
+        unsigned mask = 0;
+        for(int group = 0; group < 4; ++group){
+            __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + way + 4 * group)), key);
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(equal)) << (4 * group);
+        }
+        if(mask)
+            return way + __builtin_ctz(mask);
+    }
+#endif
+    for(; way < n; ++way)
+        if(tags[way] == tag)
+            return way;
+    return -1;
+}
+
+//same as find_way for 64-bit tags: AVX2 compares 4 per vector, SSE4.1 2 per vector (SSE2 has no 64-bit compare)
+int find_way64(const unsigned long *tags, int n, unsigned long tag)
+{
+    int way = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi64x((long long)tag);
+    for(; way + 16 <= n; way += 16){
+        unsigned mask = 0;
+        for(int group = 0; group < 4; ++group){
+            __m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(tags + way + 4 * group)), key);
+            mask |= (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(equal)) << (4 * group);
+        }
+        if(mask)
+            return way + __builtin_ctz(mask);
+    }
+#elif defined(__SSE4_1__)
+    __m128i key = _mm_set1_epi64x((long long)tag);
+    for(; way + 16 <= n; way += 16){
+        unsigned mask = 0;
+        for(int group = 0; group < 8; ++group){
+            __m128i equal = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i*)(tags + way + 2 * group)), key);
+            mask |= (unsigned)_mm_movemask_pd(_mm_castsi128_pd(equal)) << (2 * group);
+        }
+        if(mask)
+            return way + __builtin_ctz(mask);
+    }
+#endif
+    for(; way < n; ++way)
+        if(tags[way] == tag)
+            return way;
+    return -1;
+}
+
+//unlink a way from the LRU list
+void unlink_way(struct Set* set, int way)
+{
+    if(set -> newer[way] >= 0)
+        set -> older[set -> newer[way]] = set -> older[way];
+    else
+        set -> mru = set -> older[way];
+    if(set -> older[way] >= 0)
+        set -> newer[set -> older[way]] = set -> newer[way];
+    else
+        set -> lru = set -> newer[way];
+}
+
+//link a way as the head node (MRU) of the LRU list
+void link_way_to_head(struct Set* set, int way)
+{
+    set -> newer[way] = -1;
+    set -> older[way] = set -> mru;
+    if(set -> mru >= 0)
+        set -> newer[set -> mru] = way;
+    else
+        set -> lru = way;
+    set -> mru = way;
+}
+
+//unlink the line holding "block" from the victim cache and return it, or NULL if it is not there
+struct VictimLine* victim_remove(unsigned long block)
+{
+    struct VictimLine *current_line = victim.head_line;
+    struct VictimLine *previous_line = NULL;
+    while(current_line != NULL){
+        if(current_line -> block == block){
+            if(previous_line != NULL)
+                previous_line -> next = current_line -> next;
+            else
+                victim.head_line = current_line -> next;
+            victim.size--;
+            return current_line;
+        }
+        previous_line = current_line;
+        current_line = current_line -> next;
+    }
+    return NULL;
+}
+
+//insert a block as the MRU line of the victim cache, evict the LRU line when it is full
+//return the dirty bit of the evicted line
+int victim_insert(unsigned long block, int dirty_bit)
+{
+    int dirty = 0;
+    if(victim.size == victim.capacity){
+        struct VictimLine *current_line = victim.head_line;
+        struct VictimLine *previous_line = NULL;
+        while(current_line -> next != NULL){
+            previous_line = current_line;
+            current_line = current_line -> next;
+        }
+        if(previous_line != NULL)
+            previous_line -> next = NULL;
+        else
+            victim.head_line = NULL;
+        dirty = current_line -> dirty_bit;
+        if(dirty)
+            writeback_block = current_line -> block;
+        free(current_line);
+        victim.size--;
+        victim.evictions++;
+    }
+    struct VictimLine *line = malloc(sizeof(struct VictimLine));
+    line -> block = block;
+    line -> dirty_bit = dirty_bit;
+    line -> next = victim.head_line;
+    victim.head_line = line;
+    victim.size++;
+    return dirty;
+}
+
+/*
+ *event log (-v): every block access is appended to a binary log (see csim-log.h, csim-log decodes it).
+ *the access functions leave the set and the evicted tag of the last access here for it.
+ *records collect in a large buffer that is written out when it fills up, so logging an access
+ *costs a few stores instead of a printf.
+ */
+#define LOG_BUFFER_RECORDS 65536
+int event_set;
+unsigned long event_victim_tag;
+FILE* log_file = NULL;
+char* log_path = LOG_DEFAULT_PATH;
+struct LogRecord* log_buffer = NULL;
+int log_used = 0;
+
+//evict the line of a way, the way is reused by the new line
+//return whether the eviction wrote a dirty line back to memory
+int evict_way(struct Set* set, int way){
+    event_victim_tag = tag_of(set, way);
+    unlink_way(set, way);
+    if(partitioned)
+        set -> valid &= ~(1ULL << way);
+    if(set -> owners != NULL && set -> owners[way] != current_tenant)
+        tenants[set -> owners[way]].lost++;
+    if(set -> hash != NULL)
+        hash_remove(set, tag_of(set, way));
+    set -> size--;
+    int dirty = set -> dirty_bits[way];
+    //with a victim cache the line moves there, and only the line it pushes out goes back to memory
+    if(victim.kind == VICTIM_CACHE)
+        dirty = victim_insert(block_of(tag_of(set, way), set -> index), dirty);
+    else if(dirty)
+        writeback_block = block_of(tag_of(set, way), set -> index);
+    if(dirty)
+        dirty_bytes_evicted++;
+    return dirty;
+}
+
+//create a function to evict the last line (LRU node)
+int evict_last_line(struct Set* set){
+    return evict_way(set, set -> lru);
+}
+
+//way a partitioned tenant fills: its first empty way, or else its least recently used way
+int partition_way(struct Set* set)
+{
+    unsigned long long allowed = tenants[current_tenant].way_mask;
+    if(set -> E < 64)
+        allowed &= (1ULL << set -> E) - 1;
+    if(allowed & ~set -> valid)
+        return __builtin_ctzll(allowed & ~set -> valid);
+    int way = set -> lru;
+    while(!((allowed >> way) & 1))
+        way = set -> newer[way];
+    return way;
+}
+
+//with way partitioning the valid ways are not 0..size-1, so look at each valid way
+int find_valid_way(struct Set* set, unsigned long tag)
+{
+    for(unsigned long long valid = set -> valid; valid != 0; valid &= valid - 1){
+        int way = __builtin_ctzll(valid);
+        if(tag_of(set, way) == tag)
+            return way;
+    }
+    return -1;
+}
+
+
+//add a valid line to the head of a set (only if the set is still available), evict the line when the set is over its capacity
+//return the ACCESS_* flags describing the eviction, if any
+int add_new_line_to_head(struct Set* set, unsigned long tag, int dirty_bit){
+    int outcome = ACCESS_MISS;
+    int way = set -> size;
+    if(partitioned){
+        //the tenant may only fill the ways of its mask, evict the line there if that way is taken
+        way = partition_way(set);
+        if((set -> valid >> way) & 1){
+            outcome |= ACCESS_EVICT;
+            if(evict_way(set, way))
+                outcome |= ACCESS_DIRTY_EVICT;
+            evict++;
+        }
+        set -> valid |= 1ULL << way;
+    }
+    //checking if the set is full, if the set is full then evict the current line of the set and increase the eviction count
+    else if(set_size(set) == set -> E){
+            way = set -> lru;
+            outcome |= ACCESS_EVICT;
+            if(evict_last_line(set))
+                outcome |= ACCESS_DIRTY_EVICT;
+            evict++;
+    }
+    if(set -> owners != NULL)
+        set -> owners[way] = current_tenant;
+    if(set -> tags64 != NULL)
+        set -> tags64[way] = tag;
+    else
+        set -> tags32[way] = tag;
+    set -> dirty_bits[way] = dirty_bit;
+    set -> size++;
+    if(set -> hash != NULL)
+        set -> hash[hash_slot(set, tag)] = way + 1;
+    link_way_to_head(set, way); //the new line is the MRU node
+    return outcome;
+}
+
+//a helper function to move the matched line to head (MRU node)
+void move_match_line_to_head(struct Set* set, int way){
+    if(set -> mru != way){
+        unlink_way(set, way);
+        link_way_to_head(set, way);
+    }
+} 
+
+//look up a block the main cache missed on in the victim or miss cache, return ACCESS_VICTIM_HIT if it was there
+//a victim cache hands the line (and its dirty bit) over to the new line, a miss cache keeps a copy of every missed block
+int access_victim(unsigned long block, int* dirty_bit)
+{
+    if(victim.kind == VICTIM_CACHE){
+        struct VictimLine *found = victim_remove(block);
+        if(found == NULL)
+            return 0;
+        *dirty_bit |= found -> dirty_bit;
+        free(found);
+        victim.hits++;
+        return ACCESS_VICTIM_HIT;
+    }
+    if(victim.kind == MISS_CACHE){
+        struct VictimLine *found = victim_remove(block);
+        if(found == NULL){
+            victim_insert(block, 0);
+            return 0;
+        }
+        //move the copy back to the MRU position
+        found -> next = victim.head_line;
+        victim.head_line = found;
+        victim.size++;
+        victim.hits++;
+        return ACCESS_VICTIM_HIT;
+    }
+    return 0;
+}
+
+//cache operation helper function, return the ACCESS_* outcome of the access
+int access_cache(struct Cache* cache, char operation, unsigned long address)
+{
+    unsigned long tag_bits;
+    int set_index = set_index_of(address >> b, &tag_bits);
+    event_set = set_index;
+    if(tag_bits > 0xffffffffUL && cache -> tags32 != NULL)
+        widen_tags(cache);
+    //check if it is in the "L" operation and "S" operation 
+    struct Set* current_set = &cache -> sets[set_index];
+    //need to check for the line for a hit
+    int way;
+    if(current_set -> hash != NULL){
+        way = current_set -> hash[hash_slot(current_set, tag_bits)] - 1;
+    }
+    else if(partitioned){
+        way = find_valid_way(current_set, tag_bits);
+    }
+    else{
+        if(current_set -> tags64 != NULL)
+            way = find_way64(current_set -> tags64, current_set -> size, tag_bits);
+        else
+            way = find_way(current_set -> tags32, current_set -> size, tag_bits);
+    }
+    if(way >= 0){
+        hit++;
+        if(operation == 'S')
+            current_set -> dirty_bits[way] = 1; // it is a store operation so still need to change the dirty bit to 1
+        if(way == current_set -> mru) //a second reference to the MRU line
+            double_refs++; 
+        move_match_line_to_head(current_set, way);
+        return ACCESS_HIT;
+    }
+    miss++;
+    int dirty_bit = operation == 'S';
+    int outcome = access_victim(address >> b, &dirty_bit);
+    //a function to write a line to the head_line which is the MRU node
+    outcome |= add_new_line_to_head(current_set, tag_bits, dirty_bit);
+    if((outcome & ACCESS_VICTIM_HIT) && (outcome & ACCESS_EVICT) && victim.kind == VICTIM_CACHE)
+        victim.swaps++;
+    return outcome;
+}
+
+//cache operation of the skewed-associative cache, return the ACCESS_* outcome of the access
+int access_skewed(struct Cache* cache, char operation, unsigned long address)
+{
+    unsigned long block = address >> b;
+    struct SkewLine* mru = NULL;
+    struct SkewLine* lru = NULL;
+    struct SkewLine* match = NULL;
+    ++skew_clock;
+    for(int way = 0; way < E; ++way){
+        struct SkewLine* line = &cache -> skew_lines[(size_t)way * cache -> S + skew_index(block, way)];
+        if(line -> valid && line -> block == block)
+            match = line;
+        if(line -> valid && (mru == NULL || line -> last_used > mru -> last_used))
+            mru = line;
+        if(lru == NULL || (lru -> valid && (!line -> valid || line -> last_used < lru -> last_used)))
+            lru = line;
+    }
+    if(match != NULL){
+        hit++;
+        if(operation == 'S')
+            match -> dirty_bit = 1;
+        if(match == mru) //the most recently used of the candidate lines plays the role of the head line
+            double_refs++;
+        match -> last_used = skew_clock;
+        return ACCESS_HIT;
+    }
+    miss++;
+    int dirty_bit = operation == 'S';
+    int outcome = access_victim(block, &dirty_bit);
+    outcome |= ACCESS_MISS;
+    event_set = (lru - cache -> skew_lines) % cache -> S;
+    if(lru -> valid){
+        outcome |= ACCESS_EVICT;
+        evict++;
+        event_victim_tag = lru -> block >> s;
+        int dirty = lru -> dirty_bit;
+        if(victim.kind == VICTIM_CACHE)
+            dirty = victim_insert(lru -> block, dirty);
+        else if(dirty)
+            writeback_block = lru -> block;
+        if(dirty){
+            dirty_bytes_evicted++;
+            outcome |= ACCESS_DIRTY_EVICT;
+        }
+        if(outcome & ACCESS_VICTIM_HIT && victim.kind == VICTIM_CACHE)
+            victim.swaps++;
+    }
+    lru -> valid = 1;
+    lru -> block = block;
+    lru -> dirty_bit = dirty_bit;
+    lru -> last_used = skew_clock;
+    return outcome;
+}
+
+//the lookup function of the configured cache organization
+int (*access_func)(struct Cache* cache, char operation, unsigned long address) = access_cache;
+
+/*
+ *a kernel specialized for the requested geometry (see csim-kernel.h) replaces access_cache when
+ *nothing but the plain cache is simulated: modulo indexing and no victim or miss cache.
+ *the kernels only exist for the geometries make was given in CSIM_GEOMETRIES.
+ */
+struct Kernel* kernel = NULL;
+int generic_flag = 0; //--generic: always use the generic engine
+
+struct Kernel* find_kernel(int s, int E, int b)
+{
+    if(generic_flag || index_kind != INDEX_MODULO || victim.kind != VICTIM_NONE || tenant_count > 1 || partitioned ||
+       log_file != NULL || dram.channels > 0)
+        return NULL;
+    for(struct Kernel* k = kernels; k -> access != NULL; ++k)
+        if(k -> s == s && k -> E == E && k -> b == b)
+            return k;
+    return NULL;
+}
+
+//allocate the MSHRs of the latency model
+void initialize_timing(void)
+{
+    if(mshr_count > 0)
+        timing.mshr = calloc(mshr_count, sizeof(unsigned long long));
+}
+
+//total cycles so far: the issue clock, or the last outstanding miss if it finishes later
+unsigned long long timing_cycles(void)
+{
+    return (timing.now > timing.last_done ? timing.now : timing.last_done) - timing.start;
+}
+
+//print the timing of the current interval and start the next one
+void timing_interval(void)
+{
+    unsigned long long cycles = timing_cycles();
+    unsigned long long accesses = timing.accesses - timing.interval_accesses;
+    unsigned long long elapsed = cycles - timing.interval_cycles;
+    unsigned long long bytes = timing.bytes - timing.interval_bytes;
+    printf("interval:%ld accesses:%llu cycles:%llu amat:%.2f bandwidth_util:%.3f\n",
+           timing.interval_count, accesses, elapsed,
+           accesses ? (double)(timing.latency_sum - timing.interval_latency_sum) / accesses : 0.0,
+           elapsed ? (double)bytes / ((double)elapsed * memory_bandwidth) : 0.0);
+    timing.interval_count++;
+    timing.interval_accesses = timing.accesses;
+    timing.interval_cycles = cycles;
+    timing.interval_latency_sum = timing.latency_sum;
+    timing.interval_bytes = timing.bytes;
+}
+
+/*
+ * charge one block access to the latency model.
+ * Every access spends hit_latency cycles in the tag lookup. A miss then waits for a free MSHR
+ * (if they are bounded), for memory_latency cycles, and for the memory bus to transfer the block;
+ * a dirty eviction transfers its block over the same bus first. A miss served by the victim or
+ * miss cache only costs its extra latency.
+ * With MSHRs the issue clock only stalls when all of them are busy, so misses overlap;
+ * without them the clock waits for every miss to complete.
+ */
+void timing_access(int outcome)
+{
+    unsigned long long block_bytes = 1ULL << b;
+    unsigned long long transfer = (block_bytes + memory_bandwidth - 1) / memory_bandwidth;
+    unsigned long long start = timing.now;
+    timing.accesses++;
+    timing.now += hit_latency;
+    if(outcome & ACCESS_VICTIM_HIT){
+        //served next to the cache, only a dirty line pushed out of it uses the memory bus
+        if(outcome & ACCESS_DIRTY_EVICT){
+            if(timing.bus_free < timing.now)
+                timing.bus_free = timing.now;
+            timing.bus_free += transfer;
+            timing.bytes += block_bytes;
+        }
+        timing.now += victim.latency;
+        timing.latency_sum += hit_latency + victim.latency;
+    }
+    else if(outcome & ACCESS_MISS){
+        unsigned long long issue = timing.now;
+        int slot = 0;
+        if(mshr_count > 0){
+            //take the MSHR that frees up first and stall until it does
+            for(int i = 1; i < mshr_count; ++i)
+                if(timing.mshr[i] < timing.mshr[slot])
+                    slot = i;
+            if(timing.mshr[slot] > issue)
+                issue = timing.mshr[slot];
+        }
+        if(timing.bus_free < issue)
+            timing.bus_free = issue;
+        if(outcome & ACCESS_DIRTY_EVICT){
+            timing.bus_free += transfer;
+            timing.bytes += block_bytes;
+        }
+        unsigned long long arrive = issue + memory_latency;
+        unsigned long long done = (arrive > timing.bus_free ? arrive : timing.bus_free) + transfer;
+        timing.bus_free = done;
+        timing.bytes += block_bytes;
+        timing.latency_sum += done - start;
+        if(done > timing.last_done)
+            timing.last_done = done;
+        if(mshr_count > 0){
+            timing.mshr[slot] = done;
+            timing.now = issue;
+        }
+        else{
+            timing.now = done;
+        }
+    }
+    else{
+        timing.latency_sum += hit_latency;
+    }
+    if(interval > 0 && timing.accesses - timing.interval_accesses == (unsigned long long)interval)
+        timing_interval();
+}
+
+void log_flush(void)
+{
+    fwrite(log_buffer, sizeof(struct LogRecord), log_used, log_file);
+    log_used = 0;
+}
+
+static inline void log_event(char operation, unsigned long address, int outcome, int walk)
+{
+    struct LogRecord* record = &log_buffer[log_used];
+    record -> address = address;
+    record -> victim_tag = outcome & ACCESS_EVICT ? event_victim_tag : 0;
+    record -> set = event_set;
+    record -> operation = operation;
+    record -> outcome = outcome;
+    record -> tenant = current_tenant;
+    record -> walk = walk;
+    if(++log_used == LOG_BUFFER_RECORDS)
+        log_flush();
+}
+
+//create the event log and write its header
+void log_open(void)
+{
+    struct LogHeader header = {LOG_MAGIC, s, E, b, index_kind};
+    log_file = fopen(log_path, "wb");
+    if(!log_file){
+        printf("Error: Can't create the event log %s\n", log_path);
+        exit(-1);
+    }
+    fwrite(&header, sizeof(header), 1, log_file);
+    log_buffer = malloc(LOG_BUFFER_RECORDS * sizeof(struct LogRecord));
+}
+
+void log_close(void)
+{
+    log_flush();
+    fclose(log_file);
+    free(log_buffer);
+}
+
+/*
+ *per-element attribution (--attribute, used by test-trans -a): every block access of the main cache is
+ *charged to the element of the region its address falls in, or to "other" outside every region.
+ *the counts are written to .csim_attrib, one line "<region> <element> <hits> <misses> <evictions>"
+ *per element that was accessed, elements numbered from the base of their region, "other" as element -1.
+ */
+#define MAX_REGIONS 8
+#define ATTRIBUTION_PATH ".csim_attrib"
+
+struct ElementCounts
+{
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions; //evictions caused by accessing the element
+};
+
+struct Region
+{
+    char name[32];
+    unsigned long base;
+    unsigned long bytes;
+    int element_size;
+    struct ElementCounts* elements;
+};
+struct Region regions[MAX_REGIONS];
+int region_count = 0;
+struct ElementCounts other_accesses;
+
+unsigned long element_count(const struct Region* region)
+{
+    return (region -> bytes + region -> element_size - 1) / region -> element_size;
+}
+
+//add the region of "<name>:<hex base>:<bytes>:<element size>", return 0 on success
+int add_region(const char* spec)
+{
+    struct Region* region = &regions[region_count];
+    if(region_count == MAX_REGIONS ||
+       sscanf(spec, "%31[^:]:%lx:%lu:%d", region -> name, &region -> base, &region -> bytes, &region -> element_size) != 4 ||
+       region -> element_size <= 0 || region -> bytes == 0 || strcmp(region -> name, "other") == 0)
+        return -1;
+    region -> elements = calloc(element_count(region), sizeof(struct ElementCounts));
+    region_count++;
+    return 0;
+}
+
+void attribute_access(unsigned long address, int outcome)
+{
+    struct ElementCounts* counts = &other_accesses;
+    for(int i = 0; i < region_count; ++i)
+        if(address - regions[i].base < regions[i].bytes){
+            counts = &regions[i].elements[(address - regions[i].base) / regions[i].element_size];
+            break;
+        }
+    if(outcome & ACCESS_MISS){
+        counts -> misses++;
+        if(outcome & ACCESS_EVICT)
+            counts -> evictions++;
+    }
+    else{
+        counts -> hits++;
+    }
+}
+
+void write_attribution(void)
+{
+    FILE* attribution_file = fopen(ATTRIBUTION_PATH, "w");
+    if(!attribution_file){
+        printf("Error: Can't create %s\n", ATTRIBUTION_PATH);
+        exit(-1);
+    }
+    for(int i = 0; i < region_count; ++i){
+        for(unsigned long element = 0; element < element_count(&regions[i]); ++element){
+            struct ElementCounts* counts = &regions[i].elements[element];
+            if(counts -> hits + counts -> misses > 0)
+                fprintf(attribution_file, "%s %lu %llu %llu %llu\n", regions[i].name, element,
+                        counts -> hits, counts -> misses, counts -> evictions);
+        }
+        free(regions[i].elements);
+    }
+    fprintf(attribution_file, "other -1 %llu %llu %llu\n", other_accesses.hits, other_accesses.misses,
+            other_accesses.evictions);
+    fclose(attribution_file);
+}
+
+//access one block and hand the outcome to the latency model, the DRAM back end and the event log
+//the misses and write backs reach the DRAM at the issue cycle with -l, at the access count otherwise
+int access_block(struct Cache* cache, char operation, unsigned long address, int walk)
+{
+    unsigned long long issued = l_flag ? timing.now : hit + miss;
+    int outcome = access_func(cache, operation, address);
+    if(l_flag)
+        timing_access(outcome);
+    if(dram.channels > 0){
+        if((outcome & ACCESS_MISS) && !(outcome & ACCESS_VICTIM_HIT))
+            dram_request(&dram, address >> b, 0, issued);
+        if(outcome & ACCESS_DIRTY_EVICT)
+            dram_request(&dram, writeback_block, 1, issued);
+    }
+    if(log_file != NULL)
+        log_event(operation, address, outcome, walk);
+    return outcome;
+}
+
+//simulate one block access and charge it to the latency model when it is on
+//with a TLB the address is translated first, and the page-walk loads can go through the cache too
+void simulate_block(struct Cache* cache, char operation, unsigned long address)
+{
+    if(tlb.levels > 0){
+        unsigned long walk[TLB_MAX_WALK];
+        int walk_accesses = tlb_translate(&tlb, address, walk);
+        for(int i = 0; i < walk_accesses && tlb.inject_walks; ++i){
+            //the walk loads are counted on the TLB line, hit/miss/evict stay the accesses of the trace
+            unsigned long long data_hits = hit, data_misses = miss, data_evictions = evict, data_double_refs = double_refs;
+            int outcome = access_block(cache, 'L', walk[i], 1);
+            hit = data_hits;
+            miss = data_misses;
+            evict = data_evictions;
+            double_refs = data_double_refs;
+            if(outcome & ACCESS_MISS){
+                tlb.walk_misses++;
+                if(outcome & ACCESS_EVICT)
+                    tlb.walk_evictions++;
+            }
+            else{
+                tlb.walk_hits++;
+            }
+        }
+    }
+    int outcome = access_block(cache, operation, address, 0);
+    if(region_count > 0)
+        attribute_access(address, outcome);
+    if(outcome & ACCESS_MISS){
+        tenants[current_tenant].misses++;
+        if(outcome & ACCESS_EVICT)
+            tenants[current_tenant].evictions++;
+    }
+    else{
+        tenants[current_tenant].hits++;
+    }
+}
+
+//a helper function to count how many dirty bytes active at the end of the simulation
+void count_dirty_bytes_active(struct Cache* cache){
+    for(int i = 0; cache -> sets != NULL && i < cache -> S; ++i){
+        struct Set* current_set = &cache -> sets[i];
+        for(int way = 0; way < current_set -> E; ++way){
+            int valid = partitioned ? (int)((current_set -> valid >> way) & 1) : way < current_set -> size;
+            if(valid && current_set -> dirty_bits[way])
+                ++dirty_bytes_active;
+        }
+    }
+    for(long i = 0; cache -> skew_lines != NULL && i < (long)E * cache -> S; ++i)
+        if(cache -> skew_lines[i].valid && cache -> skew_lines[i].dirty_bit)
+            ++dirty_bytes_active;
+    if(kernel != NULL)
+        dirty_bytes_active += kernel -> dirty_lines();
+    //the dirty lines held by a victim cache have not been written back yet either
+    for(struct VictimLine* line = victim.head_line; line != NULL; line = line -> next)
+        if(line -> dirty_bit)
+            ++dirty_bytes_active;
+}
+
+//free cache, its sets and lines, and the victim cache
+void free_cache(struct Cache* cache){
+    free(cache -> sets);
+    free(cache -> tags32);
+    free(cache -> tags64);
+    free(cache -> dirty_bits);
+    free(cache -> links);
+    free(cache -> hash);
+    free(cache -> owners);
+    while(victim.head_line != NULL){
+        struct VictimLine* next_line = victim.head_line -> next;
+        free(victim.head_line);
+        victim.head_line = next_line;
+    }
+    free(cache -> skew_lines);
+    free(cache);
+}
+
+/*
+ *find the ways of "count" consecutive sets from "first_set" that hold "tag", ways[i] = -1 where it is not.
+ *the tags of consecutive sets are one contiguous span of the tag array, so 32-bit tags are compared with
+ *the tag 16 at a time across set boundaries (16 sets per compare for a direct-mapped cache), and a match
+ *only counts in a valid way of its set. 64-bit tags are looked up set by set with find_way64.
+ */
+void find_ways_in_sets(struct Cache* cache, int first_set, int count, unsigned long tag, int* ways)
+{
+    struct Set* sets = cache -> sets + first_set;
+    for(int i = 0; i < count; ++i)
+        ways[i] = -1;
+    if(cache -> tags64 != NULL){
+        for(int i = 0; i < count; ++i)
+            ways[i] = find_way64(sets[i].tags64, sets[i].size, tag);
+        return;
+    }
+    const unsigned* tags = sets[0].tags32;
+    int n = count * E;
+    int position = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32((int)tag);
+    for(; position + 16 <= n; position += 16){
+        __m256i low = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags + position)), key);
+        __m256i high = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags + position + 8)), key);
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(low)) |
+               ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8);
+        for(; mask != 0; mask &= mask - 1){
+            int match = position + __builtin_ctz(mask);
+            if(match % E < sets[match / E].size)
+                ways[match / E] = match % E;
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32((int)tag);
+    for(; position + 16 <= n; position += 16){
+        unsigned mask = 0;
+        for(int group = 0; group < 4; ++group){
+            __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + position + 4 * group)), key);
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(equal)) << (4 * group);
+        }
+        for(; mask != 0; mask &= mask - 1){
+            int match = position + __builtin_ctz(mask);
+            if(match % E < sets[match / E].size)
+                ways[match / E] = match % E;
+        }
+    }
+#endif
+    for(; position < n; ++position)
+        if(tags[position] == tag && position % E < sets[position / E].size)
+            ways[position / E] = position % E;
+}
+
+//whether access_blocks may simulate the blocks of an access: the generic engine with modulo indexing,
+//and no model that has to see each block access on its own (victim cache, partitioning, TLB, latency, DRAM, log, attribution)
+static inline int blocks_batchable(void)
+{
+    return access_func == access_cache && index_kind == INDEX_MODULO && victim.kind == VICTIM_NONE && !partitioned &&
+           E < HASH_MIN_WAYS && tlb.levels == 0 && !l_flag && dram.channels == 0 && log_file == NULL && region_count == 0;
+}
+
+#define RANGE_SETS 256 //sets looked up in one batch by access_blocks
+
+/*
+ *simulate the blocks first_block..last_block of one access, in order.
+ *with modulo indexing consecutive blocks fall into consecutive sets with the same tag until the index wraps,
+ *and each of those sets is touched once, so their lookups are independent: each batch is looked up at once
+ *(find_ways_in_sets) before any of its blocks is filled.
+ *the store of "M" always hits the line its load just made the MRU line, so it is counted without a second lookup.
+ */
+void access_blocks(struct Cache* cache, char operation, unsigned long first_block, unsigned long last_block)
+{
+    int ways[RANGE_SETS];
+    struct Tenant* tenant = &tenants[current_tenant];
+    unsigned long block = first_block;
+    while(block <= last_block){
+        unsigned long tag = block >> s;
+        int first_set = block & (cache -> S - 1);
+        unsigned long count = last_block - block + 1;
+        if(count > (unsigned long)(cache -> S - first_set))
+            count = cache -> S - first_set;
+        if(count > RANGE_SETS)
+            count = RANGE_SETS;
+        if(tag > 0xffffffffUL && cache -> tags32 != NULL)
+            widen_tags(cache);
+        find_ways_in_sets(cache, first_set, count, tag, ways);
+        for(unsigned long i = 0; i < count; ++i){
+            struct Set* set = &cache -> sets[first_set + i];
+            int way = ways[i];
+            if(way >= 0){
+                hit++;
+                tenant -> hits++;
+                if(operation == 'S')
+                    set -> dirty_bits[way] = 1;
+                if(way == set -> mru)
+                    double_refs++;
+                move_match_line_to_head(set, way);
+            }
+            else{
+                miss++;
+                tenant -> misses++;
+                if(add_new_line_to_head(set, tag, operation == 'S') & ACCESS_EVICT)
+                    tenant -> evictions++;
+                way = set -> mru;
+            }
+            if(operation == 'M'){
+                hit++;
+                double_refs++;
+                tenant -> hits++;
+                set -> dirty_bits[way] = 1;
+            }
+        }
+        block += count;
+    }
+}
+
+/*
+ * split an access of "size" bytes into every block it touches.
+ * The common case (size-aware mode off, or the access fits in one block) is a single
+ * compare of the first and last block numbers and goes straight to access_cache.
+ * Otherwise the whole block range is simulated in one pass: by access_blocks, which
+ * looks up a batch of consecutive sets at once, when nothing but the cache has to see
+ * the blocks, or else block by block, "M" as a load followed by a store of each block.
+ */
+void access_range(struct Cache* cache, char operation, unsigned long address, int size)
+{
+    unsigned long first_block = address >> b;
+    unsigned long last_block = (address + (size > 0 ? size - 1 : 0)) >> b;
+    if(!z_flag || first_block == last_block){
+        if(operation == 'M'){
+            simulate_block(cache, 'L', address);
+            simulate_block(cache, 'S', address); //modify contains both load and store so repeat the process to access cache twice
+        }
+        else{
+            simulate_block(cache, operation, address);
+        }
+        return;
+    }
+    split_accesses++;
+    split_blocks += last_block - first_block + 1;
+    if(blocks_batchable()){
+        access_blocks(cache, operation, first_block, last_block);
+        return;
+    }
+    for(unsigned long block = first_block; block <= last_block; ++block){
+        if(operation == 'M'){
+            simulate_block(cache, 'L', block << b);
+            simulate_block(cache, 'S', block << b);
+        }
+        else{
+            simulate_block(cache, operation, block << b);
+        }
+    }
+}
+
+//read the next record of a tenant, mark the tenant done at the end of its trace
+void read_tenant_record(struct Tenant* tenant)
+{
+    int fields;
+    //" %c" skips the leading space of data records, and the "," separates the address from the size
+    if(schedule == SCHEDULE_TIMESTAMP)
+        fields = fscanf(tenant -> trace, " %llu %c %lx,%d", &tenant -> timestamp,
+                        &tenant -> operation, &tenant -> address, &tenant -> size) - 1;
+    else
+        fields = fscanf(tenant -> trace, " %c %lx,%d", &tenant -> operation, &tenant -> address, &tenant -> size);
+    tenant -> done = fields != 3;
+}
+
+//pick the tenant whose record is simulated next according to the schedule, -1 once every trace is exhausted
+int next_tenant(void)
+{
+    static int turn = 0;
+    static long used = 0;
+    if(schedule == SCHEDULE_TIMESTAMP){
+        int next = -1;
+        for(int i = 0; i < tenant_count; ++i)
+            if(!tenants[i].done && (next < 0 || tenants[i].timestamp < tenants[next].timestamp))
+                next = i;
+        return next;
+    }
+    //round-robin is a time slice of one record
+    for(int tries = 0; tries <= tenant_count; ++tries){
+        if(used < slice && !tenants[turn].done){
+            used++;
+            return turn;
+        }
+        turn = (turn + 1) % tenant_count;
+        used = 0;
+    }
+    return -1;
+}
 
 /*
- *define the data structure of a line in cache as linked list
-*/
+ *stride runs: transpose and stencil traces are mostly made of a few interleaved streams of records whose
+ *addresses advance by a constant stride, like the load of A and the store of B of a transpose. read_run gathers
+ *such a run from the trace: "lanes" records repeat with the same operations and sizes, lane k of period q
+ *accessing base + q * stride of lane k. Instruction records do not touch the data cache and do not break a run.
+ *simulate_run keeps the block each lane accessed last for as long as it is the MRU line of its set, that is until
+ *another access puts a different block at the head of that set. A record that stays inside that block is a hit on
+ *the MRU line, which changes nothing but the hit and double reference counters (a store finds its line already
+ *dirty, since the lane stored to it before), so it is counted without a cache access, and whole periods in which
+ *every lane does so are counted at once. A lane whose stride is at least a block needs a lookup per record to know
+ *whether its block is still cached, so its records are simulated one at a time.
+ *the results are the same as without runs for every geometry, index function and victim cache; runs are not used
+ *with the models that see every access (latency model, TLB, event log), the skewed cache, whose LRU clock ticks on
+ *every hit, and several tenants, whose records are interleaved by the schedule.
+ *runs are only used with --runs: parsing the text trace costs more than the lookups they save, so they are not
+ *faster on traces without long runs.
+ */
+#define RUN_MAX_LANES 4
+#define RUN_WINDOW 16 //records read ahead to find the lanes of a run, a power of 2
 
-struct Line
+struct Lane
 {
-    int valid;
-    unsigned tag;
-    int dirty_bit;
-    struct Line *next; //address of the next node
+    char operation;
+    int size;
+    unsigned long base;
+    long stride;
 };
 
-/*
- *define the data structure of a set in cache as linked list
- */
-
-struct Set
+struct Run
 {
-    int E;
-    struct Line *head_line; //address of the head node of the line
-    struct Set *next; //address of the next node   
+    int lanes;
+    struct Lane lane[RUN_MAX_LANES];
+    long count; //records, the last period may be incomplete
 };
 
-/*
- * Implement the cache as a linked list that the matched node is the MRU node and the last node is LRU node
- * Therefore, if I want to implement LRU policy, I just need to remove the last node
- */
-
-struct Cache
+struct Record
 {
-    int S;
-    struct Set *head_set; //address of the head node of the set
+    char operation;
+    int size;
+    unsigned long address;
 };
 
+int runs_flag = 0; //--runs
+int run_stats_flag = 0; //--run-stats
+unsigned long long runs = 0;
+unsigned long long run_records = 0;
+unsigned long long bulk_records = 0; //records counted without a cache access
+//data records read ahead and not simulated yet, a ring buffer of window_size records from window_start on
+struct Record window[RUN_WINDOW];
+int window_start = 0;
+int window_size = 0;
+#define WINDOW(r) window[(window_start + (r)) & (RUN_WINDOW - 1)]
 
-//initialize a set with the capacity of E number of lines
-void initialize_set(struct Set *set, int E)
+static inline int is_data_record(char operation)
 {
-    set->E = E;
-    set->head_line = NULL;
-    set->next = NULL;
+    return operation == 'L' || operation == 'S' || operation == 'M';
 }
 
-//initialize cache with 2^s empty sets
+//whether a record is the next one of lane "record % lanes" of the run
+static inline int run_continues(struct Run* run, long record, char operation, unsigned long address, int size)
+{
+    struct Lane* lane = &run -> lane[record % run -> lanes];
+    return operation == lane -> operation && size == lane -> size &&
+           address == lane -> base + lane -> stride * (record / run -> lanes);
+}
 
-void initialize_cache(struct Cache* cache, int s, int E)
-    {
-        cache -> S = (1 << s);
-        struct Set* current_set = malloc(sizeof(struct Set));
-        initialize_set(current_set,E); //need to initialize the head_set before going through the for-loop
-        cache -> head_set = current_set;
-        for(int i=0; i < cache -> S - 1; ++i){
-            struct Set *next_set = malloc(sizeof(struct Set));
-            initialize_set(next_set, E);
-            current_set -> next = next_set;
-            current_set = next_set;
+//length of the run of the window records with the given number of lanes, 0 if they do not repeat
+long window_run(struct Run* run, int lanes)
+{
+    if(2 * lanes > window_size)
+        return 0;
+    run -> lanes = lanes;
+    for(int k = 0; k < lanes; ++k){
+        if(WINDOW(k).operation != WINDOW(k + lanes).operation || WINDOW(k).size != WINDOW(k + lanes).size)
+            return 0;
+        run -> lane[k].operation = WINDOW(k).operation;
+        run -> lane[k].size = WINDOW(k).size;
+        run -> lane[k].base = WINDOW(k).address;
+        run -> lane[k].stride = WINDOW(k + lanes).address - WINDOW(k).address;
+    }
+    long count = 2 * lanes;
+    while(count < window_size &&
+          run_continues(run, count, WINDOW(count).operation, WINDOW(count).address, WINDOW(count).size))
+        count++;
+    return count;
+}
+
+//gather the next run of the tenant's trace, the run is empty at the end of the trace
+void read_run(struct Tenant* tenant, struct Run* run)
+{
+    while(window_size < RUN_WINDOW && !tenant -> done){
+        if(is_data_record(tenant -> operation)){
+            WINDOW(window_size).operation = tenant -> operation;
+            WINDOW(window_size).size = tenant -> size;
+            WINDOW(window_size).address = tenant -> address;
+            window_size++;
+        }
+        read_tenant_record(tenant);
+    }
+    if(window_size == 0){
+        run -> count = 0;
+        return;
+    }
+    //the number of lanes that explains the most records, a single record is a run of one lane
+    struct Run candidate;
+    run -> lanes = 1;
+    run -> lane[0].operation = WINDOW(0).operation;
+    run -> lane[0].size = WINDOW(0).size;
+    run -> lane[0].base = WINDOW(0).address;
+    run -> lane[0].stride = 0;
+    run -> count = 1;
+    for(int lanes = 1; lanes <= RUN_MAX_LANES; ++lanes){
+        long count = window_run(&candidate, lanes);
+        if(count > run -> count){
+            *run = candidate;
+            run -> count = count;
+        }
+    }
+    if(run -> count < window_size){
+        window_start = (window_start + run -> count) & (RUN_WINDOW - 1);
+        window_size -= run -> count;
+        return;
+    }
+    //the whole window is part of the run, it goes on with the rest of the trace
+    window_size = 0;
+    while(!tenant -> done){
+        if(is_data_record(tenant -> operation)){
+            if(!run_continues(run, run -> count, tenant -> operation, tenant -> address, tenant -> size))
+                break;
+            run -> count++;
         }
+        read_tenant_record(tenant);
     }
+}
 
-//calculate number of valid lines in a set. Will use it to determine when the set is full
+//bytes after the first one of a record that must be in the same block as the first one
+static inline unsigned long record_extent(int size)
+{
+    return z_flag && size > 0 ? size - 1 : 0;
+}
 
-int set_size(struct Set *set)
+//number of records of a lane, from period "first" on and at most "limit", whose bytes all lie in block "hot"
+long lane_records_in_block(struct Lane* lane, long first, long limit, unsigned long hot)
 {
-    struct Line *current_line = set -> head_line; //starting from the head node of the line
-    int size = 0;
-    while (current_line != NULL)
-    {
-        ++size;
-        current_line = current_line -> next;
+    unsigned long low = hot << b;
+    unsigned long high = low + ((1UL << b) - 1);
+    unsigned long address = lane -> base + lane -> stride * first;
+    unsigned long extent = record_extent(lane -> size);
+    if(address < low || address > high || high - address < extent)
+        return 0;
+    if(lane -> stride == 0)
+        return limit;
+    //the records move away from the block boundary they start next to
+    unsigned long room = lane -> stride > 0 ? high - extent - address : address - low;
+    unsigned long step = lane -> stride > 0 ? lane -> stride : -lane -> stride;
+    unsigned long fit = room / step + 1;
+    return fit < (unsigned long)limit ? (long)fit : limit;
+}
+
+void simulate_run(struct Cache* cache, struct Run* run)
+{
+    unsigned long hot[RUN_MAX_LANES], tag;
+    int hot_valid[RUN_MAX_LANES] = {0};
+    int lanes = run -> lanes;
+    runs++;
+    run_records += run -> count;
+    for(long i = 0; i < run -> count; ){
+        int k = i % lanes;
+        long period = i / lanes;
+        //whole periods in which every lane stays in its MRU block
+        if(k == 0){
+            long periods = (run -> count - i) / lanes;
+            for(int j = 0; j < lanes && periods > 0; ++j)
+                periods = hot_valid[j] ? lane_records_in_block(&run -> lane[j], period, periods, hot[j]) : 0;
+            if(periods > 0){
+                for(int j = 0; j < lanes; ++j){
+                    unsigned long long accesses = periods * (run -> lane[j].operation == 'M' ? 2 : 1);
+                    hit += accesses;
+                    double_refs += accesses;
+                    tenants[current_tenant].hits += accesses;
+                }
+                bulk_records += periods * lanes;
+                i += periods * lanes;
+                continue;
+            }
+        }
+        struct Lane* lane = &run -> lane[k];
+        unsigned long address = lane -> base + lane -> stride * period;
+        unsigned long first = address >> b;
+        unsigned long last = (address + record_extent(lane -> size)) >> b;
+        i++;
+        if(hot_valid[k] && first == hot[k] && last == hot[k]){
+            unsigned long long accesses = lane -> operation == 'M' ? 2 : 1;
+            hit += accesses;
+            double_refs += accesses;
+            tenants[current_tenant].hits += accesses;
+            bulk_records++;
+            continue;
+        }
+        access_range(cache, lane -> operation, address, lane -> size);
+        //the blocks it accessed are now the MRU lines of their sets
+        for(unsigned long block = first; block <= last; ++block)
+            for(int j = 0; j < lanes; ++j)
+                if(hot_valid[j] && hot[j] != block && set_index_of(hot[j], &tag) == set_index_of(block, &tag))
+                    hot_valid[j] = 0;
+        hot[k] = last;
+        hot_valid[k] = 1;
     }
-    return size;
 }
 
-//create a function to evict the last line. Need to have access to 3 lines which are the null node, MRU node and LRU node
-void evict_last_line(struct Set* set){
-    struct Line *current_line = set -> head_line;
-    struct Line *previous_line = NULL;
-    struct Line *previous_line_1 = NULL;
-    while(current_line != NULL){
-        previous_line_1 = previous_line;
-        previous_line = current_line;
-        current_line = current_line -> next;
+//simulate the trace of a single tenant as stride runs
+void simulate_runs(struct Cache* cache, struct Tenant* tenant)
+{
+    struct Run run;
+    for(read_run(tenant, &run); run.count > 0; read_run(tenant, &run))
+        simulate_run(cache, &run);
+}
+
+//simulate the traces of the tenants, whose first records have been read
+void simulate_trace(struct Cache* cache, int bulk)
+{
+    if(bulk)
+        simulate_runs(cache, &tenants[0]);
+
+//reading through each line by fscanf. A line is composed of an operation, operation address, size
+//convert the operation address into set index and tag
+    //a single trace is tenant 0 alone, so it is read through the same scheduler
+    int next;
+    while((next = next_tenant()) >= 0){
+            struct Tenant* tenant = &tenants[next];
+            char operation = tenant -> operation;
+            unsigned long operation_address = tenant -> address;
+            int size = tenant -> size;
+            current_tenant = next;
+            switch(operation){
+                case 'I':
+                    break;
+                case 'L':
+                case 'S':
+                case 'M':
+                    //need a function to read and access something from "my cache" and "operation_address"
+                    access_range(cache, operation, operation_address, size);
+                    break;
+                default:
+                    break;
+            } 
+            read_tenant_record(tenant);
     }
-    if(previous_line_1 != NULL){
-        previous_line_1-> next = NULL;} //it is the last line so need to assign the next address to point to a NULL
-    else{
-        set -> head_line = NULL;}
-    if(previous_line -> dirty_bit)
-        dirty_bytes_evicted++;
-    if(previous_line != NULL)
-        free(previous_line);
 }
 
+/*
+ *daemon mode (--server <socket>): named caches stay resident between the requests of the clients
+ *of a Unix socket, see server.h for the protocol. The engine keeps its state in globals, so the
+ *instance being served has its state swapped into them and every other instance holds its own.
+ *each instance has its own geometry, the other options of the daemon apply to all of them.
+ */
+#define MAX_INSTANCES 64
+
+struct Instance
+{
+    char name[SERVER_MAX_NAME + 1];
+    struct Cache* cache;
+    //swapped with the globals of the same name, they hold the daemon's own values while it is loaded
+    int s, E, b, prime_sets;
+    unsigned long long hit, miss, evict, dirty_bytes_evicted, double_refs, split_accesses, split_blocks;
+    unsigned long skew_clock;
+    struct VictimCache victim;
+    struct Timing timing;
+};
+struct Instance* instances[MAX_INSTANCES];
+int instance_count = 0;
+struct Instance* loaded = NULL; //instance whose state is in the globals
+
+#define SWAP(type, a, b) do { type swapped = a; a = b; b = swapped; } while(0)
 
-//add a valid line to the head of a set (only if the set is still available), evict the line when the set is over its capacity
-void add_new_line_to_head(struct Line* line, struct Set* set){
-    //checking if the set is full, if the set is full then evict the current line of the set and increase the eviction count
-    if(set_size(set) == set -> E){
-            evict_last_line(set);
-            evict++;
+//exchange the engine globals with the state of an instance, doing it twice restores both
+void swap_instance_state(struct Instance* instance)
+{
+    SWAP(int, s, instance -> s);
+    SWAP(int, E, instance -> E);
+    SWAP(int, b, instance -> b);
+    SWAP(int, prime_sets, instance -> prime_sets);
+    SWAP(unsigned long long, hit, instance -> hit);
+    SWAP(unsigned long long, miss, instance -> miss);
+    SWAP(unsigned long long, evict, instance -> evict);
+    SWAP(unsigned long long, dirty_bytes_evicted, instance -> dirty_bytes_evicted);
+    SWAP(unsigned long long, double_refs, instance -> double_refs);
+    SWAP(unsigned long long, split_accesses, instance -> split_accesses);
+    SWAP(unsigned long long, split_blocks, instance -> split_blocks);
+    SWAP(unsigned long, skew_clock, instance -> skew_clock);
+    SWAP(struct VictimCache, victim, instance -> victim);
+    SWAP(struct Timing, timing, instance -> timing);
+}
+
+//make "instance" the loaded one, NULL puts the daemon's own globals back
+void instance_switch(struct Instance* instance)
+{
+    if(loaded == instance)
+        return;
+    if(loaded != NULL)
+        swap_instance_state(loaded);
+    loaded = instance;
+    if(instance != NULL){
+        swap_instance_state(instance);
+        t = memory_address - s - b;
     }
-    line -> next = set -> head_line; //address of the next line points to the head_line
-    set -> head_line = line; //update the line to be the head_line of the set
 }
 
-//a helper function to move the matched line to head (MRU node)
-void move_match_line_to_head(struct Set* set, struct Line* current_line, struct Line* previous_line){
-    if(previous_line != NULL){
-        previous_line -> next = current_line -> next;
-        current_line -> next = set-> head_line;
-        set-> head_line = current_line;
+struct Instance* instance_find(const char* name)
+{
+    for(int i = 0; i < instance_count; ++i)
+        if(strcmp(instances[i] -> name, name) == 0)
+            return instances[i];
+    return NULL;
+}
+
+//create a cache instance, its victim cache and latency model take the configuration of the daemon
+struct Instance* instance_open(const char* name, int new_s, int new_E, int new_b)
+{
+    instance_switch(NULL);
+    struct Instance* instance = calloc(1, sizeof(struct Instance));
+    strcpy(instance -> name, name);
+    instance -> s = new_s;
+    instance -> E = new_E;
+    instance -> b = new_b;
+    instance -> victim = victim;
+    instance -> victim.size = 0;
+    instance -> victim.head_line = NULL;
+    instance -> victim.hits = instance -> victim.swaps = instance -> victim.evictions = 0;
+    instance_switch(instance);
+    prime_sets = index_kind == INDEX_PRIME ? set_count(s) : 1;
+    instance -> cache = malloc(sizeof(struct Cache));
+    initialize_cache(instance -> cache, s, E);
+    if(l_flag)
+        initialize_timing();
+    instances[instance_count++] = instance;
+    return instance;
+}
+
+void instance_close(struct Instance* instance)
+{
+    instance_switch(instance);
+    free_cache(instance -> cache);
+    free(timing.mshr);
+    instance_switch(NULL);
+    for(int i = 0; i < instance_count; ++i)
+        if(instances[i] == instance)
+            instances[i] = instances[--instance_count];
+    free(instance);
+}
+
+//zero the counters of the loaded instance, the cache contents and the latency model state stay
+void instance_reset(void)
+{
+    hit = miss = evict = dirty_bytes_evicted = double_refs = 0;
+    split_accesses = split_blocks = 0;
+    victim.hits = victim.swaps = victim.evictions = 0;
+    timing.accesses = timing.latency_sum = timing.bytes = 0;
+    timing.interval_accesses = timing.interval_cycles = timing.interval_latency_sum = timing.interval_bytes = 0;
+    timing.interval_count = 0;
+    //the clock keeps running for the misses still outstanding, the cycles count from here
+    timing.start += timing_cycles();
+}
+
+//handle one request of a client, return 1 to stop the daemon
+int handle_request(const struct ServerRequest* request, struct ServerReply* reply)
+{
+    struct Instance* instance = instance_find(request -> name);
+    if(request -> type == SERVER_MSG_SHUTDOWN)
+        return 1;
+    if(request -> type == SERVER_MSG_OPEN){
+        int geometry[3];
+        if(request -> length != sizeof(geometry)){
+            reply -> status = SERVER_BAD_REQUEST;
+            return 0;
+        }
+        memcpy(geometry, request -> payload, sizeof(geometry));
+        if(instance != NULL){
+            instance_switch(instance);
+            if(s != geometry[0] || E != geometry[1] || b != geometry[2])
+                reply -> status = SERVER_BAD_GEOMETRY;
+        }
+        else if(geometry[0] < 0 || geometry[0] > 30 || geometry[1] <= 0 || geometry[2] < 0 ||
+                geometry[0] + geometry[2] >= memory_address || (1L << geometry[0]) * geometry[1] > (1L << 28)){
+            reply -> status = SERVER_BAD_GEOMETRY;
+        }
+        else if(instance_count == MAX_INSTANCES){
+            reply -> status = SERVER_BAD_REQUEST;
+        }
+        else{
+            instance_open(request -> name, geometry[0], geometry[1], geometry[2]);
+        }
+        return 0;
     }
-} 
+    if(instance == NULL){
+        reply -> status = SERVER_NO_CACHE;
+        return 0;
+    }
+    instance_switch(instance);
+    switch(request -> type){
+        case SERVER_MSG_ACCESS:
+            if(request -> length % SERVER_RECORD_SIZE != 0){
+                reply -> status = SERVER_BAD_REQUEST;
+                break;
+            }
+            for(unsigned long i = 0; i < request -> length; i += SERVER_RECORD_SIZE){
+                char operation;
+                unsigned long address;
+                int size;
+                server_get_record(request -> payload + i, &operation, &address, &size);
+                if(operation == 'L' || operation == 'S' || operation == 'M')
+                    access_range(instance -> cache, operation, address, size);
+            }
+            break;
+        case SERVER_MSG_STATS:{
+            unsigned long long counters[SERVER_STATS];
+            dirty_bytes_active = 0;
+            count_dirty_bytes_active(instance -> cache);
+            counters[0] = hit;
+            counters[1] = miss;
+            counters[2] = evict;
+            counters[3] = (1ULL << b) * dirty_bytes_evicted;
+            counters[4] = (1ULL << b) * dirty_bytes_active;
+            counters[5] = double_refs;
+            counters[6] = l_flag ? timing_cycles() : 0;
+            memcpy(reply -> payload, counters, sizeof(counters));
+            reply -> length = sizeof(counters);
+            break;
+        }
+        case SERVER_MSG_RESET:
+            instance_reset();
+            break;
+        case SERVER_MSG_CLOSE:
+            instance_close(instance);
+            break;
+        default:
+            reply -> status = SERVER_BAD_REQUEST;
+            break;
+    }
+    return 0;
+}
 
-//cache operation helper function
-void access_cache(struct Cache* cache, char operation, unsigned long address)
+//client mode (--connect): replay the -t trace into a cache of the daemon and report its counters
+void run_client(const char* path, const char* name, int reset)
 {
-    int tag_bits = address >> (s + b);
-    int set_index = (address << t) >> (t + b);
-    //check if it is in the "L" operation and "S" operation 
-    //how to get the correct set
-    struct Set* current_set = cache -> head_set;
-    for (int i = 0; i < set_index; ++i)
-    {
-        current_set = current_set -> next; //access each set
+    static unsigned char batch[4096 * SERVER_RECORD_SIZE];
+    struct ServerReply reply;
+    int geometry[3] = {s, E, b};
+    int fd = server_connect(path);
+    if(fd < 0){
+        printf("Error: Can't connect to the daemon at %s\n", path);
+        exit(-1);
     }
-    //need to check for the line for a hit
-    struct Line* current_line = current_set -> head_line; // access the first line of the set
-    struct Line* previous_line = NULL;
-    while (current_line != NULL){
-        if((current_line -> tag == tag_bits) && (current_line -> valid)){
-            hit++;
-           // move_match_line_to_head(current_set, current_line, previous_line);
-            if(operation == 'S')
-                current_line -> dirty_bit = 1; // it is a store operation so still need to change the dirty bit to 1
-            if(current_line -> tag == current_set -> head_line -> tag) //if the current line -> dirty bit just recently changed to 1 then the if statement could be wrong
-                double_refs++; 
-            move_match_line_to_head(current_set, current_line, previous_line);
-            return; //get out of the loop and increment hit
+    if(server_call(fd, SERVER_MSG_OPEN, name, geometry, sizeof(geometry), &reply) < 0)
+        reply.status = SERVER_BAD_REQUEST;
+    if(reply.status == SERVER_BAD_VERSION){
+        printf("Error: The daemon at %s speaks another version of the protocol, restart it\n", path);
+        exit(-1);
+    }
+    if(reply.status != SERVER_OK){
+        printf("Error: Can't open cache \"%s\" with s=%d E=%d b=%d\n", name, s, E, b);
+        exit(-1);
+    }
+    if(reset && (server_call(fd, SERVER_MSG_RESET, name, NULL, 0, &reply) < 0 || reply.status != SERVER_OK)){
+        printf("Error: Can't reset cache \"%s\"\n", name);
+        exit(-1);
+    }
+    unsigned long used = 0;
+    struct Tenant* tenant = &tenants[0];
+    for(read_tenant_record(tenant); !tenant -> done || used > 0; read_tenant_record(tenant)){
+        if(!tenant -> done && tenant -> operation != 'I'){
+            server_put_record(batch + used, tenant -> operation, tenant -> address, tenant -> size);
+            used += SERVER_RECORD_SIZE;
+            if(used < sizeof(batch))
+                continue;
         }
-        previous_line = current_line;
-        current_line = current_line -> next;
+        //a full batch, or the last one at the end of the trace
+        if(used > 0 && (server_call(fd, SERVER_MSG_ACCESS, name, batch, used, &reply) < 0 || reply.status != SERVER_OK)){
+            printf("Error: The daemon rejected the accesses to cache \"%s\"\n", name);
+            exit(-1);
+        }
+        used = 0;
     }
-    miss++;
-    struct Line* new_line = malloc(sizeof(struct Line)); //create a new line
-    new_line -> valid = 1;
-    new_line -> tag = tag_bits;
-    if(operation == 'S'){
-        new_line -> dirty_bit = 1;}
-    else{
-        new_line -> dirty_bit = 0;
+    if(server_call(fd, SERVER_MSG_STATS, name, NULL, 0, &reply) < 0 || reply.status != SERVER_OK){
+        printf("Error: Can't read the counters of cache \"%s\"\n", name);
+        exit(-1);
     }
-    //a function to write a line to the head_line which is the MRU node
-    add_new_line_to_head(new_line,current_set);    
+    unsigned long long counters[SERVER_STATS];
+    memcpy(counters, reply.payload, sizeof(counters));
+    close(fd);
+    printSummary64(counters[0], counters[1], counters[2], counters[3], counters[4], counters[5]);
+    if(counters[6] > 0)
+        printf("cycles:%llu\n", counters[6]);
 }
 
-//a helper function to count how many dirty bytes active at the end of the simulation
-void count_dirty_bytes_active(struct Cache* cache){
-    struct Set* current_set = cache -> head_set;
-    while(current_set != NULL){
-        struct Line* current_line = current_set -> head_line;// start from the head line
-        //current_set = current_set -> next; //moving to the next set until reaching null
-        while(current_line != NULL){
-            if(current_line -> dirty_bit)
-                ++dirty_bytes_active;
-            current_line = current_line -> next; //moving to the next line until reaching null
-        
-        } 
-        current_set = current_set -> next; //moving to the next set until reaching null
+/*
+ *batch mode (--batch <manifest>): the traces of a manifest are simulated with the same options, each one in the
+ *cache emptied by reset_cache and with its counters zeroed, so it gets the counters a csim process of its own
+ *would print. The cache is set up once, --jobs worker processes each take a copy of it (see batch.c), and the
+ *counters of every trace go into one report instead of .csim_results.
+ */
+//the lines of split accesses, stride runs and the victim or miss cache printed after the summary
+void format_statistics(char* text, size_t size)
+{
+    int length = 0;
+    text[0] = '\0';
+    if(z_flag)
+        length += snprintf(text + length, size - length, "split_accesses:%llu split_blocks:%llu\n",
+                           split_accesses, split_blocks);
+    if(run_stats_flag)
+        length += snprintf(text + length, size - length, "runs:%llu run_records:%llu bulk_records:%llu\n",
+                           runs, run_records, bulk_records);
+    if(victim.kind == VICTIM_CACHE)
+        snprintf(text + length, size - length,
+                 "victim_hits:%llu victim_swaps:%llu victim_evictions:%llu memory_misses:%llu\n",
+                 victim.hits, victim.swaps, victim.evictions, miss - victim.hits);
+    else if(victim.kind == MISS_CACHE)
+        snprintf(text + length, size - length, "miss_cache_hits:%llu memory_misses:%llu\n",
+                 victim.hits, miss - victim.hits);
+}
+
+char* batch_path = NULL;
+int batch_jobs = 0; //0: one worker per online core
+struct Cache* batch_cache = NULL;
+int batch_bulk = 0; //stride runs are used (--runs)
+
+//simulate one trace of the batch in batch_cache
+void simulate_batch_trace(const char* trace, struct BatchResult* result)
+{
+    tenants[0].trace = fopen(trace, "r");
+    if(tenants[0].trace == NULL){
+        result -> status = BATCH_FAILED;
+        return;
+    }
+    if(kernel != NULL)
+        kernel -> reset();
+    else
+        reset_cache(batch_cache, E);
+    instance_reset();
+    dirty_bytes_active = 0;
+    runs = run_records = bulk_records = 0;
+    unsigned long long* mshr = timing.mshr;
+    memset(&timing, 0, sizeof(timing));
+    timing.mshr = mshr;
+    if(mshr != NULL)
+        memset(mshr, 0, mshr_count * sizeof(unsigned long long));
+
+    read_tenant_record(&tenants[0]);
+    simulate_trace(batch_cache, batch_bulk);
+    fclose(tenants[0].trace);
+    count_dirty_bytes_active(batch_cache);
+    result -> counters[0] = hit;
+    result -> counters[1] = miss;
+    result -> counters[2] = evict;
+    result -> counters[3] = (1ULL << b) * dirty_bytes_evicted;
+    result -> counters[4] = (1ULL << b) * dirty_bytes_active;
+    result -> counters[5] = double_refs;
+    result -> counters[6] = l_flag ? timing_cycles() : 0;
+    result -> amat = timing.accesses ? (double)timing.latency_sum / timing.accesses : 0.0;
+    format_statistics(result -> details, sizeof(result -> details));
+    if(index_kind != INDEX_MODULO){
+        int length = strlen(result -> details);
+        snprintf(result -> details + length, sizeof(result -> details) - length, "index:%s sets:%d\n",
+                 index_names[index_kind], set_count(s));
     }
+    result -> status = BATCH_DONE;
 }
 
-//free cache, free every set, free every line
-void free_cache(struct Cache* cache){
-    //start with clearing the head set in cache
-    struct Set* free_this_set = cache -> head_set;
-    //clear all set except the head set then clear the head set
-    while(!free_this_set){
-        struct Line* free_this_line = free_this_set-> head_line;
-        //clear all line except the head line then clear the head line
-        while(!free_this_line){
-            struct Line* free_other_lines = free_this_line -> next;
-            free(free_other_lines);
-            free_this_line = free_other_lines; //traverse through the linked list
-        }
-        //using the same logic to clear all lines to clear all sets
-        struct Set* free_other_sets = free_this_set -> next;
-        free(free_other_sets);
-        free_this_set = free_other_sets;
+//simulate the traces of the manifest and print the report, return the number of traces that failed
+int run_batch(const char* manifest, struct Cache* cache, int bulk)
+{
+    struct Batch batch;
+    if(batch_read_manifest(&batch, manifest) < 0){
+        printf("Error: Can't read the traces of the manifest %s\n", manifest);
+        exit(-1);
+    }
+    if(batch_jobs <= 0)
+        batch_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if(batch_jobs > batch.count)
+        batch_jobs = batch.count;
+    batch_cache = cache;
+    batch_bulk = bulk;
+    if(batch_run(&batch, batch_jobs, simulate_batch_trace) < 0){
+        printf("Error: Can't start the batch workers\n");
+        exit(-1);
     }
+    int failed = batch_print_report(&batch, batch_jobs, l_flag);
+    batch_free(&batch);
+    return failed;
 }
 
+//print the usage info of the simulator
+void usage(char* argv[])
+{
+    printf("Usage: %s [-hvzl] [--options] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Log every access to %s (decode it with csim-log).\n", LOG_DEFAULT_PATH);
+    printf("  -z         Size-aware mode: split accesses that span multiple blocks.\n");
+    printf("  -l         Latency model: report estimated cycles, AMAT and bandwidth utilization.\n");
+    printf("  -s <num>   Number of set index bits.\n");
+    printf("  -E <num>   Number of lines per set.\n");
+    printf("  -b <num>   Number of block offset bits.\n");
+    printf("  -t <file>  Trace file.\n");
+    printf("  --tenant <file>    Interleave another tenant's trace into the cache.\n");
+    printf("  --schedule <kind>  Interleaving of the tenants: rr (default), slice:<n> or timestamp.\n");
+    printf("  --ways <mask>[,<mask>...]  Hex way mask of each tenant (CAT-style partitioning).\n");
+    printf("  --log <file>       Write the event log of -v to <file>.\n");
+    printf("  --attribute <name>:<base>:<bytes>:<size>  Count the accesses to each <size>-byte element\n");
+    printf("                     of the region at hex <base> in %s (may be repeated).\n", ATTRIBUTION_PATH);
+    printf("  --generic          Do not use a kernel specialized for the geometry.\n");
+    printf("  --runs             Count the hits of the stride runs of the trace without simulating them.\n");
+    printf("  --run-stats        Same as --runs, and report the runs found in the trace.\n");
+    printf("  --batch <manifest> Simulate every trace listed in <manifest> (one per line) instead of -t.\n");
+    printf("  --jobs <num>       Worker processes of --batch (default: one per online core).\n");
+    printf("  --server <socket>  Run as a daemon keeping named caches for the clients of a Unix socket.\n");
+    printf("  --connect <socket> Simulate the trace in a cache of that daemon, with the daemon's options.\n");
+    printf("  --cache <name>     Name of that cache (default \"default\").\n");
+    printf("  --reset            Zero the counters of that cache before the trace.\n");
+    printf("  --shutdown         Stop the daemon of --connect.\n");
+    printf("  --index <kind>     Set index function: modulo (default), xor, prime or skew.\n");
+    printf("  --victim <num>     Add a fully associative victim cache of <num> lines.\n");
+    printf("  --miss-cache <num> Add a fully associative miss cache of <num> lines instead.\n");
+    printf("  --tlb <entries>:<ways>[,...]  Simulate a TLB, one <entries>:<ways> pair per level.\n");
+    printf("  --page-size <4k|2m|1g>        Page size of the TLB model (default 4k).\n");
+    printf("  --page-range <lo>-<hi>=<size> Map the hex address range [lo,hi) with <size> pages.\n");
+    printf("  --inject-walks                Send the page-walk loads through the cache.\n");
+    printf("  --dram <channels>:<ranks>:<banks>  Send the misses and write backs to a DRAM model.\n");
+    printf("  --dram-row <bytes>                 Row buffer size (default %d).\n", dram.row_bytes);
+    printf("  --dram-map <fields>                Address mapping, most significant first\n");
+    printf("                                     (default row:rank:bank:channel:column).\n");
+    printf("  --dram-xor                         Xor the bank bits with the low row bits.\n");
+    printf("  --dram-page <open|closed>          Row buffer policy (default open).\n");
+    printf("  --dram-queue <num>                 Requests queued per channel (default %d).\n", dram.depth);
+    printf("  --dram-timing <cas>:<rcd>:<rp>:<burst>  DRAM timing in cycles (default %d:%d:%d:%d).\n",
+           dram.t_cas, dram.t_rcd, dram.t_rp, dram.t_burst);
+    printf("Latency model options (imply -l):\n");
+    printf("  --hit-latency <cycles>     Cache hit latency (default %d).\n", hit_latency);
+    printf("  --mem-latency <cycles>     Memory latency (default %d).\n", memory_latency);
+    printf("  --mem-bandwidth <bytes>    Memory bytes transferred per cycle (default %d).\n", memory_bandwidth);
+    printf("  --mshr <num>               Outstanding misses allowed, 0 for a blocking cache (default 0).\n");
+    printf("  --interval <num>           Report timing every <num> block accesses.\n");
+    printf("  --victim-latency <cycles>  Extra latency of a victim/miss cache hit (default %d).\n", victim.latency);
+}
+
+/*
+ *long options, their values start above the range of the short option characters
+ */
+enum
+{
+    OPT_HIT_LATENCY = 256,
+    OPT_MEM_LATENCY,
+    OPT_MEM_BANDWIDTH,
+    OPT_MSHR,
+    OPT_INTERVAL,
+    OPT_VICTIM,
+    OPT_MISS_CACHE,
+    OPT_VICTIM_LATENCY,
+    OPT_TLB,
+    OPT_PAGE_SIZE,
+    OPT_PAGE_RANGE,
+    OPT_INJECT_WALKS,
+    OPT_INDEX,
+    OPT_GENERIC,
+    OPT_TENANT,
+    OPT_SCHEDULE,
+    OPT_WAYS,
+    OPT_SERVER,
+    OPT_CONNECT,
+    OPT_CACHE,
+    OPT_RESET,
+    OPT_SHUTDOWN,
+    OPT_LOG,
+    OPT_RUNS,
+    OPT_RUN_STATS,
+    OPT_DRAM,
+    OPT_DRAM_ROW,
+    OPT_DRAM_MAP,
+    OPT_DRAM_XOR,
+    OPT_DRAM_PAGE,
+    OPT_DRAM_QUEUE,
+    OPT_DRAM_TIMING,
+    OPT_BATCH,
+    OPT_JOBS,
+    OPT_ATTRIBUTE
+};
+
+static struct option long_options[] =
+{
+    {"hit-latency", required_argument, NULL, OPT_HIT_LATENCY},
+    {"mem-latency", required_argument, NULL, OPT_MEM_LATENCY},
+    {"mem-bandwidth", required_argument, NULL, OPT_MEM_BANDWIDTH},
+    {"mshr", required_argument, NULL, OPT_MSHR},
+    {"interval", required_argument, NULL, OPT_INTERVAL},
+    {"victim", required_argument, NULL, OPT_VICTIM},
+    {"miss-cache", required_argument, NULL, OPT_MISS_CACHE},
+    {"victim-latency", required_argument, NULL, OPT_VICTIM_LATENCY},
+    {"tlb", required_argument, NULL, OPT_TLB},
+    {"page-size", required_argument, NULL, OPT_PAGE_SIZE},
+    {"page-range", required_argument, NULL, OPT_PAGE_RANGE},
+    {"inject-walks", no_argument, NULL, OPT_INJECT_WALKS},
+    {"index", required_argument, NULL, OPT_INDEX},
+    {"generic", no_argument, NULL, OPT_GENERIC},
+    {"tenant", required_argument, NULL, OPT_TENANT},
+    {"schedule", required_argument, NULL, OPT_SCHEDULE},
+    {"ways", required_argument, NULL, OPT_WAYS},
+    {"server", required_argument, NULL, OPT_SERVER},
+    {"connect", required_argument, NULL, OPT_CONNECT},
+    {"cache", required_argument, NULL, OPT_CACHE},
+    {"reset", no_argument, NULL, OPT_RESET},
+    {"shutdown", no_argument, NULL, OPT_SHUTDOWN},
+    {"log", required_argument, NULL, OPT_LOG},
+    {"runs", no_argument, NULL, OPT_RUNS},
+    {"run-stats", no_argument, NULL, OPT_RUN_STATS},
+    {"dram", required_argument, NULL, OPT_DRAM},
+    {"dram-row", required_argument, NULL, OPT_DRAM_ROW},
+    {"dram-map", required_argument, NULL, OPT_DRAM_MAP},
+    {"dram-xor", no_argument, NULL, OPT_DRAM_XOR},
+    {"dram-page", required_argument, NULL, OPT_DRAM_PAGE},
+    {"dram-queue", required_argument, NULL, OPT_DRAM_QUEUE},
+    {"dram-timing", required_argument, NULL, OPT_DRAM_TIMING},
+    {"batch", required_argument, NULL, OPT_BATCH},
+    {"jobs", required_argument, NULL, OPT_JOBS},
+    {"attribute", required_argument, NULL, OPT_ATTRIBUTE},
+    {NULL, 0, NULL, 0}
+};
 
 int main(int argc, char*argv[])
 {
     int opt;
-    FILE* tracefile;
+    FILE* tracefile = NULL;
     char* trace;
+    char* server_path = NULL;
+    char* connect_path = NULL;
+    char* cache_name = "default";
+    int reset_flag = 0;
+    int shutdown_flag = 0;
+    int way_masks = 0; //tenants --ways gave a mask
 
-    /* parse flag commands by using getopt() */
-    while((opt = getopt(argc,argv, "hvs:E:b:t:")) != -1) //":" specify an argument expected after the flag
+    /* parse flag commands by using getopt_long(), the long options only configure the optional models */
+    while((opt = getopt_long(argc,argv, "hvzls:E:b:t:", long_options, NULL)) != -1) //":" specify an argument expected after the flag
         switch (opt)
         {
             case 'h':
                 h_flag = 1;
-                break;
+                usage(argv);
+                exit(0);
             case 'v':
                 v_flag = 1;
                 break;   
+            case 'z':
+                z_flag = 1;
+                break;
+            case 'l':
+                l_flag = 1;
+                break;
+            case OPT_HIT_LATENCY:
+                sscanf(optarg, "%d", &hit_latency);
+                l_flag = 1;
+                break;
+            case OPT_MEM_LATENCY:
+                sscanf(optarg, "%d", &memory_latency);
+                l_flag = 1;
+                break;
+            case OPT_MEM_BANDWIDTH:
+                sscanf(optarg, "%d", &memory_bandwidth);
+                l_flag = 1;
+                break;
+            case OPT_MSHR:
+                sscanf(optarg, "%d", &mshr_count);
+                l_flag = 1;
+                break;
+            case OPT_INTERVAL:
+                sscanf(optarg, "%ld", &interval);
+                l_flag = 1;
+                break;
+            case OPT_VICTIM:
+                sscanf(optarg, "%d", &victim.capacity);
+                victim.kind = victim.capacity > 0 ? VICTIM_CACHE : VICTIM_NONE;
+                break;
+            case OPT_MISS_CACHE:
+                sscanf(optarg, "%d", &victim.capacity);
+                victim.kind = victim.capacity > 0 ? MISS_CACHE : VICTIM_NONE;
+                break;
+            case OPT_VICTIM_LATENCY:
+                sscanf(optarg, "%d", &victim.latency);
+                l_flag = 1;
+                break;
+            case OPT_TLB:
+                if(tlb_configure(&tlb, optarg) < 0){
+                    printf("Error: invalid TLB configuration \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_PAGE_SIZE:
+                tlb.page_shift = tlb_parse_page_size(optarg);
+                if(tlb.page_shift < 0){
+                    printf("Error: invalid page size \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_PAGE_RANGE:
+                if(tlb_add_page_range(&tlb, optarg) < 0){
+                    printf("Error: invalid page range \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_INJECT_WALKS:
+                tlb.inject_walks = 1;
+                break;
+            case OPT_DRAM:
+                if(dram_configure(&dram, optarg) < 0){
+                    printf("Error: invalid DRAM configuration \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_DRAM_ROW:
+                sscanf(optarg, "%d", &dram.row_bytes);
+                break;
+            case OPT_DRAM_MAP:
+                if(dram_set_mapping(&dram, optarg) < 0){
+                    printf("Error: invalid DRAM mapping \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_DRAM_XOR:
+                dram.xor_banks = 1;
+                break;
+            case OPT_DRAM_PAGE:
+                if(strcmp(optarg, "open") == 0)
+                    dram.policy = DRAM_OPEN_PAGE;
+                else if(strcmp(optarg, "closed") == 0)
+                    dram.policy = DRAM_CLOSED_PAGE;
+                else{
+                    printf("Error: invalid page policy \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_DRAM_QUEUE:
+                sscanf(optarg, "%d", &dram.depth);
+                break;
+            case OPT_DRAM_TIMING:
+                if(dram_set_timing(&dram, optarg) < 0){
+                    printf("Error: invalid DRAM timing \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_TENANT:
+                if(tenant_count == MAX_TENANTS - 1){
+                    printf("Error: at most %d tenants\n", MAX_TENANTS);
+                    exit(-1);
+                }
+                tenants[++tenant_count].name = optarg; //tenant 0 is the -t trace
+                break;
+            case OPT_SCHEDULE:
+                if(strcmp(optarg, "rr") == 0)
+                    schedule = SCHEDULE_RR;
+                else if(strcmp(optarg, "timestamp") == 0)
+                    schedule = SCHEDULE_TIMESTAMP;
+                else if(sscanf(optarg, "slice:%ld", &slice) == 1 && slice > 0)
+                    schedule = SCHEDULE_SLICE;
+                else{
+                    printf("Error: invalid schedule \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_WAYS:{
+                char* mask = optarg;
+                for(way_masks = 0; way_masks < MAX_TENANTS && *mask; ++way_masks){
+                    tenants[way_masks].way_mask = strtoull(mask, &mask, 16);
+                    if(*mask == ',')
+                        mask++;
+                }
+                partitioned = 1;
+                break;
+            }
+            case OPT_GENERIC:
+                generic_flag = 1;
+                break;
+            case OPT_SERVER:
+                server_path = optarg;
+                break;
+            case OPT_CONNECT:
+                connect_path = optarg;
+                break;
+            case OPT_BATCH:
+                batch_path = optarg;
+                break;
+            case OPT_JOBS:
+                sscanf(optarg, "%d", &batch_jobs);
+                break;
+            case OPT_ATTRIBUTE:
+                if(add_region(optarg) < 0){
+                    printf("Error: invalid region \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case OPT_CACHE:
+                cache_name = optarg;
+                break;
+            case OPT_RESET:
+                reset_flag = 1;
+                break;
+            case OPT_SHUTDOWN:
+                shutdown_flag = 1;
+                break;
+            case OPT_LOG:
+                log_path = optarg;
+                v_flag = 1;
+                break;
+            case OPT_RUNS:
+                runs_flag = 1;
+                break;
+            case OPT_RUN_STATS:
+                runs_flag = 1;
+                run_stats_flag = 1;
+                break;
+            case OPT_INDEX:
+                index_kind = -1;
+                for(int i = 0; i < 4; ++i)
+                    if(strcmp(optarg, index_names[i]) == 0)
+                        index_kind = i;
+                if(index_kind < 0){
+                    printf("Error: invalid index function \"%s\"\n", optarg);
+                    exit(-1);
+                }
+                break;
             case 's':
                 sscanf(optarg, "%d", &s);//optarg is a char* pointing to the value of the option argument, can use sscanf 
                 //printf("this is the value of s: %d",s);
@@ -251,6 +2299,7 @@ int main(int argc, char*argv[])
                 break;
             case 't':
                 trace = optarg;
+                tenants[0].name = trace;
                 tracefile = fopen(trace, "r");
                 //printf("It is reading the tracefile");
                 if(!tracefile)
@@ -262,44 +2311,148 @@ int main(int argc, char*argv[])
             default:
                 break;
         }
-    struct Cache *my_cache = malloc(sizeof(struct Cache));
-    initialize_cache(my_cache,s,E);
-
-//reading through each line by fscanf. A line is composed of an operation, operation address, size
-//convert the operation address into set index and tag
+    if(index_kind == INDEX_XOR)
+        set_index_of = index_xor;
+    else if(index_kind == INDEX_PRIME)
+        set_index_of = index_prime;
+    else if(index_kind == INDEX_SKEW)
+        access_func = access_skewed;
+    if(server_path != NULL){
+        //every instance has its own state, the TLB, the DRAM, the tenants and the event log are not part of it
+        if(v_flag || tlb.levels > 0 || dram.channels > 0 || tenant_count > 0 || partitioned || region_count > 0){
+            printf("Error: --server does not support -v, --tlb, --dram, --tenant, --ways or --attribute\n");
+            exit(-1);
+        }
+        int listen_fd = server_listen(server_path);
+        if(listen_fd < 0){
+            printf("Error: Can't listen on %s\n", server_path);
+            exit(-1);
+        }
+        server_loop(listen_fd, handle_request);
+        close(listen_fd);
+        unlink(server_path);
+        return 0;
+    }
+    //a batch has no -t trace, and the models that print or keep state of their own are left out
+    if(batch_path != NULL && (tracefile != NULL || connect_path != NULL || v_flag || interval > 0 || tlb.levels > 0 ||
+                              dram.channels > 0 || tenant_count > 0 || partitioned || region_count > 0)){
+        printf("Error: --batch does not support -t, -v, --connect, --interval, --tlb, --dram, --tenant, --ways or --attribute\n");
+        exit(-1);
+    }
+    if(connect_path != NULL && shutdown_flag){
+        struct ServerReply reply;
+        int fd = server_connect(connect_path);
+        if(fd < 0 || server_call(fd, SERVER_MSG_SHUTDOWN, cache_name, NULL, 0, &reply) < 0){
+            printf("Error: Can't stop the daemon at %s\n", connect_path);
+            exit(-1);
+        }
+        close(fd);
+        return 0;
+    }
+    if((tracefile == NULL && batch_path == NULL) || E <= 0 || memory_bandwidth <= 0){
+        usage(argv);
+        exit(-1);
+    }
+    if(connect_path != NULL){
+        tenants[0].trace = tracefile;
+        run_client(connect_path, cache_name, reset_flag);
+        fclose(tracefile);
+        return 0;
+    }
+    //tenant 0 is the -t trace, every tenant may fill every way unless --ways says otherwise
+    tenant_count++;
+    tenants[0].trace = tracefile;
+    for(int i = 1; i < tenant_count; ++i){
+        tenants[i].trace = fopen(tenants[i].name, "r");
+        if(!tenants[i].trace){
+            printf("Error: Can't open the trace of tenant %d (%s)\n", i, tenants[i].name);
+            exit(-1);
+        }
+    }
+    if(partitioned && (E > 64 || E >= HASH_MIN_WAYS || index_kind == INDEX_SKEW)){
+        printf("Error: way partitioning needs E <= 64 and a set-associative index\n");
+        exit(-1);
+    }
+    //a tenant --ways gave no mask may fill every way, a mask must leave a tenant at least one of the E ways
+    unsigned long long all_ways = E < 64 ? (1ULL << E) - 1 : ~0ULL;
+    for(int i = 0; i < tenant_count; ++i){
+        if(!partitioned || i >= way_masks)
+            tenants[i].way_mask = ~0ULL;
+        else if((tenants[i].way_mask & all_ways) == 0){
+            printf("Error: the way mask of tenant %d has none of the %d ways\n", i, E);
+            usage(argv);
+            exit(-1);
+        }
+        if(tenants[i].trace != NULL) //a batch opens the traces of its manifest one at a time
+            read_tenant_record(&tenants[i]);
+    }
+    if(schedule == SCHEDULE_RR)
+        slice = 1;
+    if(dram.channels > 0 && dram_init(&dram, b) < 0){
+        printf("Error: the DRAM row must be a power of 2 of at least one block, the queue at least 1\n");
+        exit(-1);
+    }
     t = memory_address  - s - b;
-    char operation;
-    unsigned long operation_address;
-    int size;
-    while(fscanf(tracefile,"%c" "%lx" "%d", &operation, &operation_address, &size) > 0){
-            switch(operation){
-                case 'I':
-                    break;
-                case 'L':
-                    //need a function to read and access something from "my cache" and "operation_address"
-                    access_cache(my_cache, 'L', operation_address);
-                    break;
-                case 'S':
-                    access_cache(my_cache, 'S', operation_address);
-                    break;
-                case 'M':
-                    access_cache(my_cache, 'L', operation_address);
-                    access_cache(my_cache, 'S', operation_address); //modify contains both load and store so repeat the process to access cache twice
-                    break;
-                default:
-                    break;
-            } 
-            if(h_flag){
-                printf("there is no usage info file.\n");
-            }
-            if(v_flag){
-                printf("%c" "%lx" "%d", operation, operation_address, size);
-            }
-
+    if(index_kind == INDEX_PRIME)
+        prime_sets = set_count(s);
+    if(v_flag)
+        log_open();
+    struct Cache *my_cache = malloc(sizeof(struct Cache));
+    kernel = find_kernel(s, E, b);
+    if(kernel != NULL){
+        //the kernel keeps the cache in its own static array, the generic one stays empty
+        access_func = kernel -> access;
+        initialize_cache(my_cache, 0, 0);
+    }
+    else{
+        initialize_cache(my_cache,s,E);
     }
+    if(l_flag)
+        initialize_timing();
+    int bulk = runs_flag && !l_flag && tlb.levels == 0 && log_file == NULL && index_kind != INDEX_SKEW &&
+               tenant_count == 1 && region_count == 0;
+    if(batch_path != NULL){
+        int failed = run_batch(batch_path, my_cache, bulk);
+        free_cache(my_cache);
+        free(timing.mshr);
+        return failed > 0 ? -1 : 0;
+    }
+    simulate_trace(my_cache, bulk);
     count_dirty_bytes_active(my_cache);
-    fclose(tracefile);
+    if(v_flag)
+        log_close();
+    if(region_count > 0)
+        write_attribution();
+    for(int i = 0; i < tenant_count; ++i)
+        fclose(tenants[i].trace);
     free_cache(my_cache);
-    printSummary(hit, miss, evict,(1 << b)*dirty_bytes_evicted,(1 << b)*dirty_bytes_active,double_refs);
+    if(l_flag && interval > 0 && timing.accesses > timing.interval_accesses)
+        timing_interval(); //the last, partial interval
+    printSummary64(hit, miss, evict,(1ULL << b)*dirty_bytes_evicted,(1ULL << b)*dirty_bytes_active,double_refs);
+    char statistics[BATCH_DETAILS];
+    format_statistics(statistics, sizeof(statistics));
+    printf("%s", statistics);
+    for(int i = 0; i < tenant_count && (tenant_count > 1 || partitioned); ++i)
+        printf("tenant:%d trace:%s way_mask:%llx hits:%llu misses:%llu evictions:%llu lost_to_others:%llu\n",
+               i, tenants[i].name, tenants[i].way_mask, tenants[i].hits, tenants[i].misses,
+               tenants[i].evictions, tenants[i].lost);
+    if(index_kind != INDEX_MODULO)
+        printf("index:%s sets:%d\n", index_names[index_kind], set_count(s));
+    if(tlb.levels > 0){
+        tlb_print_summary(&tlb);
+        tlb_free(&tlb);
+    }
+    if(dram.channels > 0){
+        dram_drain(&dram);
+        dram_print_summary(&dram);
+        dram_free(&dram);
+    }
+    if(l_flag){
+        unsigned long long cycles = timing_cycles();
+        printTimingSummary(cycles,
+                           timing.accesses ? (double)timing.latency_sum / timing.accesses : 0.0,
+                           cycles ? (double)timing.bytes / ((double)cycles * memory_bandwidth) : 0.0);
+        free(timing.mshr);
+    }
     return 0;
 }
@@ -0,0 +1,37 @@
+/* 
+ * csim.h - State of the cache simulator shared with its generated kernels
+ */
+
+#ifndef CSIM_H
+#define CSIM_H
+
+/* Outcome of a single block access, returned by the access functions */
+#define ACCESS_HIT 0
+#define ACCESS_MISS 1
+#define ACCESS_EVICT 2
+#define ACCESS_DIRTY_EVICT 4 /* a dirty line left the caches and was written back to memory */
+#define ACCESS_VICTIM_HIT 8  /* the miss was served by the victim or miss cache */
+
+/* Counters reported by printSummary, defined in csim.c */
+extern unsigned long long hit;
+extern unsigned long long miss;
+extern unsigned long long evict;
+extern unsigned long long dirty_bytes_evicted; /* in lines */
+extern unsigned long long double_refs;
+
+struct Cache;
+
+/* 
+ * A simulator kernel specialized at compile time for one (s,E,b)
+ * geometry, see csim-kernel.h. The table of kernels is generated by make
+ * from CSIM_GEOMETRIES and ends with an entry whose access is NULL.
+ */
+struct Kernel {
+    int s, E, b;
+    int (*access)(struct Cache *cache, char operation, unsigned long address);
+    int (*dirty_lines)(void); /* number of dirty lines in the cache */
+    void (*reset)(void);      /* empty the cache */
+};
+extern struct Kernel kernels[];
+
+#endif /* CSIM_H */
@@ -0,0 +1,249 @@
+/*
+ * dram.c - A DRAM back end for the misses and dirty write backs of the
+ *     cache simulator.
+ *
+ * A block number is split into channel, rank, bank, row and column bits
+ * by a configurable mapping, the column being the blocks of a row buffer.
+ * Each channel has a request queue served by FR-FCFS (first ready, first
+ * come first served): a request to the open row of its bank goes ahead of
+ * older requests. With the open-page policy a bank keeps its row open
+ * after an access, so the next access is a row hit (CAS only), finds the
+ * bank precharged (activate + CAS) or conflicts with another row
+ * (precharge + activate + CAS). With the closed-page policy every access
+ * activates its row and precharges it right after.
+ *
+ * Banks work in parallel, one command is issued per cycle on a channel
+ * and the bursts of a channel share its data bus. Write recovery, refresh
+ * and the rank-to-rank turnaround are not modeled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dram.h"
+
+static const char *field_names[DRAM_FIELDS] = {"row", "rank", "bank", "channel", "column"};
+
+/* log2 of a power of 2, -1 for anything else */
+static int log2_exact(long n)
+{
+    int bits = 0;
+
+    if (n <= 0 || (n & (n - 1)) != 0)
+        return -1;
+    while ((1L << bits) < n)
+        bits++;
+    return bits;
+}
+
+int dram_configure(struct DRAM *dram, const char *spec)
+{
+    if (sscanf(spec, "%d:%d:%d", &dram->channels, &dram->ranks, &dram->banks) != 3 ||
+        log2_exact(dram->channels) < 0 || log2_exact(dram->ranks) < 0 ||
+        log2_exact(dram->banks) < 0) {
+        dram->channels = 0;
+        return -1;
+    }
+    return 0;
+}
+
+int dram_set_mapping(struct DRAM *dram, const char *spec)
+{
+    int seen = 0, n = 0;
+
+    while (*spec && n < DRAM_FIELDS) {
+        int length = strcspn(spec, ":"), field;
+        for (field = 0; field < DRAM_FIELDS; field++)
+            if ((int)strlen(field_names[field]) == length &&
+                strncmp(spec, field_names[field], length) == 0)
+                break;
+        if (field == DRAM_FIELDS || (seen & (1 << field)))
+            return -1;
+        seen |= 1 << field;
+        dram->order[n++] = field;
+        spec += length;
+        if (*spec == ':')
+            spec++;
+    }
+    if (*spec || n != DRAM_FIELDS || dram->order[0] != DRAM_ROW)
+        return -1;
+    return 0;
+}
+
+int dram_set_timing(struct DRAM *dram, const char *spec)
+{
+    if (sscanf(spec, "%d:%d:%d:%d", &dram->t_cas, &dram->t_rcd, &dram->t_rp,
+               &dram->t_burst) != 4 || dram->t_cas < 0 || dram->t_rcd < 0 ||
+        dram->t_rp < 0 || dram->t_burst <= 0)
+        return -1;
+    return 0;
+}
+
+int dram_init(struct DRAM *dram, int b)
+{
+    int column_bits = log2_exact(dram->row_bytes) - b;
+    int shift = 0;
+
+    if (log2_exact(dram->row_bytes) < 0 || column_bits < 0 || dram->depth <= 0)
+        return -1;
+    dram->bits[DRAM_CHANNEL] = log2_exact(dram->channels);
+    dram->bits[DRAM_RANK] = log2_exact(dram->ranks);
+    dram->bits[DRAM_BANK] = log2_exact(dram->banks);
+    dram->bits[DRAM_COLUMN] = column_bits;
+    /* the row takes whatever is above the other fields */
+    for (int i = DRAM_FIELDS - 1; i > 0; i--) {
+        dram->shift[dram->order[i]] = shift;
+        shift += dram->bits[dram->order[i]];
+    }
+    dram->shift[DRAM_ROW] = shift;
+    dram->bits[DRAM_ROW] = 64 - shift;
+
+    dram->channel = calloc(dram->channels, sizeof(struct DRAMChannel));
+    for (int c = 0; c < dram->channels; c++) {
+        dram->channel[c].queue = calloc(dram->depth, sizeof(struct DRAMRequest));
+        dram->channel[c].banks = calloc(dram->ranks * dram->banks, sizeof(struct DRAMBank));
+        for (int k = 0; k < dram->ranks * dram->banks; k++)
+            dram->channel[c].banks[k].open_row = -1;
+    }
+    return 0;
+}
+
+/* field - The bits of a field of the block number */
+static unsigned long field(struct DRAM *dram, unsigned long block, int which)
+{
+    if (dram->bits[which] == 0)
+        return 0;
+    block >>= dram->shift[which];
+    return dram->bits[which] >= 64 ? block : block & ((1UL << dram->bits[which]) - 1);
+}
+
+/*
+ * serve_one - Schedule the next request of a channel if it can start by
+ *     cycle limit. Returns the cycle it started, 0 if none was served.
+ */
+static unsigned long long serve_one(struct DRAM *dram, struct DRAMChannel *channel,
+                                    unsigned long long limit)
+{
+    if (channel->queued == 0)
+        return 0;
+    unsigned long long start = channel->command_free;
+    if (start < channel->queue[0].arrival)
+        start = channel->queue[0].arrival;
+    if (start > limit)
+        return 0;
+
+    /* first ready: the oldest request that has arrived and hits its open row */
+    int pick = 0;
+    for (int i = 0; i < channel->queued && channel->queue[i].arrival <= start; i++)
+        if (channel->banks[channel->queue[i].bank].open_row == (long)channel->queue[i].row) {
+            pick = i;
+            break;
+        }
+    struct DRAMRequest *request = &channel->queue[pick];
+    struct DRAMBank *bank = &channel->banks[request->bank];
+    unsigned long long issue = start > bank->ready ? start : bank->ready;
+    unsigned long long data;
+
+    if (bank->open_row == (long)request->row) {
+        dram->row_hits++;
+        data = issue + dram->t_cas;
+        bank->ready = issue + dram->t_burst;
+    }
+    else if (bank->open_row < 0) {
+        dram->row_empty++;
+        data = issue + dram->t_rcd + dram->t_cas;
+        bank->ready = issue + dram->t_rcd + dram->t_burst;
+    }
+    else {
+        dram->row_conflicts++;
+        data = issue + dram->t_rp + dram->t_rcd + dram->t_cas;
+        bank->ready = issue + dram->t_rp + dram->t_rcd + dram->t_burst;
+    }
+    if (dram->policy == DRAM_CLOSED_PAGE) {
+        bank->open_row = -1;
+        bank->ready += dram->t_rp;
+    }
+    else {
+        bank->open_row = request->row;
+    }
+
+    unsigned long long burst = data > channel->bus_free ? data : channel->bus_free;
+    unsigned long long done = burst + dram->t_burst;
+    channel->bus_free = done;
+    /*
+     * The next request may go to another bank while this one waits for its
+     * bank, but not so early that its data would be ready before the bus is.
+     */
+    channel->command_free = start + 1;
+    if (done > channel->command_free + dram->t_cas)
+        channel->command_free = done - dram->t_cas;
+    if (done > dram->last_done)
+        dram->last_done = done;
+    if (!request->write)
+        dram->read_latency_sum += done - request->arrival;
+
+    channel->queued--;
+    memmove(request, request + 1, (channel->queued - pick) * sizeof(struct DRAMRequest));
+    return start + 1;
+}
+
+void dram_request(struct DRAM *dram, unsigned long block, int write,
+                  unsigned long long now)
+{
+    unsigned long bank = field(dram, block, DRAM_BANK);
+    unsigned long row = field(dram, block, DRAM_ROW);
+    struct DRAMChannel *channel = &dram->channel[field(dram, block, DRAM_CHANNEL)];
+
+    if (dram->xor_banks)
+        bank ^= row & (dram->banks - 1);
+    now += dram->stall_cycles;
+    while (serve_one(dram, channel, now))
+        ;
+    if (channel->queued == dram->depth) {
+        /* the request, and every later one, waits for a slot to free up */
+        unsigned long long freed = serve_one(dram, channel, ~0ULL) - 1;
+        dram->queue_stalls++;
+        if (freed > now) {
+            dram->stall_cycles += freed - now;
+            now = freed;
+        }
+    }
+    struct DRAMRequest *request = &channel->queue[channel->queued++];
+    request->arrival = now;
+    request->bank = field(dram, block, DRAM_RANK) * dram->banks + bank;
+    request->row = row;
+    request->write = write;
+    if (write)
+        dram->writes++;
+    else
+        dram->reads++;
+}
+
+void dram_drain(struct DRAM *dram)
+{
+    for (int c = 0; c < dram->channels; c++)
+        while (serve_one(dram, &dram->channel[c], ~0ULL))
+            ;
+}
+
+void dram_print_summary(struct DRAM *dram)
+{
+    unsigned long requests = dram->reads + dram->writes;
+
+    printf("dram_reads:%lu dram_writes:%lu row_hits:%lu row_empty:%lu row_conflicts:%lu "
+           "row_hit_rate:%.3f queue_stalls:%lu stall_cycles:%llu avg_read_latency:%.1f "
+           "memory_cycles:%llu\n",
+           dram->reads, dram->writes, dram->row_hits, dram->row_empty, dram->row_conflicts,
+           requests ? (double)dram->row_hits / requests : 0.0, dram->queue_stalls, dram->stall_cycles,
+           dram->reads ? (double)dram->read_latency_sum / dram->reads : 0.0,
+           dram->last_done);
+}
+
+void dram_free(struct DRAM *dram)
+{
+    for (int c = 0; c < dram->channels; c++) {
+        free(dram->channel[c].queue);
+        free(dram->channel[c].banks);
+    }
+    free(dram->channel);
+    dram->channels = 0;
+}
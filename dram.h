@@ -0,0 +1,106 @@
+/*
+ * dram.h - Prototypes for the DRAM back-end model of the cache simulator
+ */
+
+#ifndef CSIM_DRAM_H
+#define CSIM_DRAM_H
+
+/* Fields of a DRAM address, as named in a mapping ("row:rank:bank:channel:column") */
+#define DRAM_ROW 0
+#define DRAM_RANK 1
+#define DRAM_BANK 2
+#define DRAM_CHANNEL 3
+#define DRAM_COLUMN 4
+#define DRAM_FIELDS 5
+
+#define DRAM_OPEN_PAGE 0
+#define DRAM_CLOSED_PAGE 1
+
+/* A request waiting in the queue of its channel */
+struct DRAMRequest {
+    unsigned long long arrival; /* cycle it reached the controller */
+    int bank;                   /* rank * banks + bank */
+    unsigned long row;
+    int write;
+};
+
+struct DRAMBank {
+    long open_row;              /* -1 when the bank is precharged */
+    unsigned long long ready;   /* cycle it can take its next command */
+};
+
+struct DRAMChannel {
+    struct DRAMRequest *queue;  /* oldest first */
+    int queued;
+    unsigned long long command_free; /* cycle the command bus is free */
+    unsigned long long bus_free;     /* cycle the data bus is free */
+    struct DRAMBank *banks;
+};
+
+struct DRAM {
+    int channels, ranks, banks; /* 0 channels: no DRAM model */
+    int row_bytes;              /* size of a row buffer */
+    int order[DRAM_FIELDS];     /* fields from the most to the least significant bits */
+    int xor_banks;              /* xor the bank bits with the low row bits */
+    int policy;                 /* DRAM_OPEN_PAGE or DRAM_CLOSED_PAGE */
+    int depth;                  /* requests a channel queue holds */
+    /* Timing in cycles: column access, activate, precharge and data burst */
+    int t_cas, t_rcd, t_rp, t_burst;
+    int shift[DRAM_FIELDS];     /* bit position of each field in the block number */
+    int bits[DRAM_FIELDS];
+    struct DRAMChannel *channel;
+    unsigned long long last_done; /* cycle the last request completed */
+    unsigned long reads, writes;
+    unsigned long row_hits;       /* the row was open */
+    unsigned long row_empty;      /* the bank was precharged */
+    unsigned long row_conflicts;  /* another row was open and had to be closed */
+    unsigned long queue_stalls;   /* requests that found their queue full */
+    unsigned long long stall_cycles; /* the requests were held back this long by full queues */
+    unsigned long long read_latency_sum;
+};
+
+/*
+ * dram_configure - Set up the geometry from "<channels>:<ranks>:<banks>".
+ *     Every number must be a power of 2. Returns 0 on success, -1 on a
+ *     malformed spec.
+ */
+int dram_configure(struct DRAM *dram, const char *spec);
+
+/*
+ * dram_set_mapping - Set the order of the address fields from
+ *     "row:rank:bank:channel:column", most significant first. Every field
+ *     appears once and the row must come first, it takes the bits above
+ *     the others.
+ */
+int dram_set_mapping(struct DRAM *dram, const char *spec);
+
+/* Set the timing from "<cas>:<rcd>:<rp>:<burst>" */
+int dram_set_timing(struct DRAM *dram, const char *spec);
+
+/*
+ * dram_init - Allocate the banks and queues for blocks of 1 << b bytes.
+ *     Returns -1 if the row buffer is not a power of 2 of at least a block,
+ *     or the queue depth is not positive.
+ */
+int dram_init(struct DRAM *dram, int b);
+
+/*
+ * dram_request - A read (or, with write set, a write back) of a block
+ *     arrives at the controller at cycle now. The requests must arrive in
+ *     order. The requests a channel would have scheduled before now are
+ *     served first, by FR-FCFS: the oldest request to an open row, or else
+ *     the oldest request. A request that finds its queue full waits for a
+ *     slot, and that wait delays every later request too.
+ */
+void dram_request(struct DRAM *dram, unsigned long block, int write,
+                  unsigned long long now);
+
+/* Serve every queued request */
+void dram_drain(struct DRAM *dram);
+
+/* Print the requests, the row-buffer outcomes and the memory cycles */
+void dram_print_summary(struct DRAM *dram);
+
+void dram_free(struct DRAM *dram);
+
+#endif /* CSIM_DRAM_H */
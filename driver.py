@@ -7,11 +7,20 @@
 #     matrices (32x32, 64x64, and 61x67) to test the correctness and
 #     performance of the transpose function.
 #
+#     The output of test-csim is cached in .trans-cache under a hash of
+#     the binaries and traces it depends on, and test-trans caches its
+#     traces and results there too, so a re-run only evaluates what
+#     changed. -n turns both caches off.
+#
 import subprocess;
 import re;
 import os;
 import sys;
 import optparse;
+import hashlib;
+import glob;
+
+CACHE_DIR = ".trans-cache"
 
 #
 # computeMissScore - compute the score depending on the number of
@@ -27,6 +36,32 @@ def computeMissScore(miss, lower, upper, full_score):
     range = (upper- lower) * 1.0
     return round((1 - score / range) * full_score, 1)
 
+#
+# runTestCsim - Run ./test-csim, or return the output of the last run
+# with the same simulator, reference simulator and traces
+#
+def runTestCsim(use_cache):
+    key = hashlib.sha1()
+    for name in ["./csim", "./csim-ref", "./test-csim"] + sorted(glob.glob("traces/*")):
+        key.update(name.encode("utf-8"))
+        if os.path.isfile(name):
+            with open(name, "rb") as f:
+                key.update(f.read())
+    path = os.path.join(CACHE_DIR, key.hexdigest() + ".test-csim")
+    if use_cache and os.path.isfile(path):
+        with open(path, "rb") as f:
+            return f.read()
+    p = subprocess.Popen("./test-csim", 
+                         shell=True, stdout=subprocess.PIPE)
+    stdout_data = p.communicate()[0]
+    if use_cache and p.returncode == 0:
+        if not os.path.isdir(CACHE_DIR):
+            os.mkdir(CACHE_DIR)
+        with open(path + ".tmp", "wb") as f:
+            f.write(stdout_data)
+        os.rename(path + ".tmp", path)
+    return stdout_data
+
 #
 # main - Main function
 #
@@ -44,15 +79,16 @@ def main():
     p = optparse.OptionParser()
     p.add_option("-A", action="store_true", dest="autograde", 
                  help="emit autoresult string for Autolab");
+    p.add_option("-n", action="store_false", dest="use_cache", default=True,
+                 help="do not use the cached results");
     opts, args = p.parse_args()
     autograde = opts.autograde
+    trans_flags = "" if opts.use_cache else " -n"
 
     # Check the correctness of the cache simulator
     print("Part A: Testing cache simulator")
     print("Running ./test-csim")
-    p = subprocess.Popen("./test-csim", 
-                         shell=True, stdout=subprocess.PIPE)
-    stdout_data = p.communicate()[0]
+    stdout_data = runTestCsim(opts.use_cache)
 
     # Emit the output from test-csim
     stdout_data = re.split("\n", str(stdout_data.decode("utf-8")))
@@ -67,21 +103,21 @@ def main():
     # 32x32 transpose
     print("Part B: Testing transpose function")
     print("Running ./test-trans -M 32 -N 32")
-    p = subprocess.Popen("./test-trans -M 32 -N 32 | grep TEST_TRANS_RESULTS", 
+    p = subprocess.Popen("./test-trans -M 32 -N 32" + trans_flags + " | grep TEST_TRANS_RESULTS", 
                          shell=True, stdout=subprocess.PIPE)
     stdout_data = p.communicate()[0]
     result32 = re.findall(r'(\d+)', str(stdout_data))
     
     # 64x64 transpose
     print("Running ./test-trans -M 64 -N 64")
-    p = subprocess.Popen("./test-trans -M 64 -N 64 | grep TEST_TRANS_RESULTS", 
+    p = subprocess.Popen("./test-trans -M 64 -N 64" + trans_flags + " | grep TEST_TRANS_RESULTS", 
                          shell=True, stdout=subprocess.PIPE)
     stdout_data = p.communicate()[0]
     result64 = re.findall(r'(\d+)', str(stdout_data))
     
     # 61x67 transpose
     print("Running ./test-trans -M 61 -N 67")
-    p = subprocess.Popen("./test-trans -M 61 -N 67 | grep TEST_TRANS_RESULTS", 
+    p = subprocess.Popen("./test-trans -M 61 -N 67" + trans_flags + " | grep TEST_TRANS_RESULTS", 
                          shell=True, stdout=subprocess.PIPE)
     stdout_data = p.communicate()[0]
     result61 = re.findall(r'(\d+)', str(stdout_data))
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# gen-kernels.sh - Generate csim-kernels.c, the simulator kernels
+#     specialized for each geometry given as "s,E,b" on the command line.
+#     The Makefile runs it with CSIM_GEOMETRIES.
+#
+# usage: ./gen-kernels.sh 5,1,5 4,2,4 ... > csim-kernels.c
+#
+geometries="$*"
+
+echo "/* csim-kernels.c - Generated by gen-kernels.sh, do not edit */"
+for geometry in $geometries; do
+    set -- $(echo "$geometry" | tr ',' ' ')
+    echo "#define KERNEL_S $1"
+    echo "#define KERNEL_E $2"
+    echo "#define KERNEL_B $3"
+    echo "#include \"csim-kernel.h\""
+done
+
+echo "#include \"csim.h\""
+echo ""
+echo "struct Kernel kernels[] = {"
+for geometry in $geometries; do
+    set -- $(echo "$geometry" | tr ',' ' ')
+    echo "    {$1, $2, $3, access_s$1_E$2_b$3, dirty_lines_s$1_E$2_b$3, reset_s$1_E$2_b$3},"
+done
+echo "    {0, 0, 0, 0, 0, 0}"
+echo "};"
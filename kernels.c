@@ -0,0 +1,504 @@
+/*
+ * kernels.c - Built-in kernels other than the transpose, so that the
+ *     loops we actually run can be cache-profiled with test-trans -k:
+ *
+ *     matmul   C = A B, blocked, on doubles
+ *     stencil  5-point 2D Jacobi step on floats
+ *     gather   out[i] = src[idx[i]] with random indices
+ *     scatter  dst[idx[i]] = src[i] with a random permutation
+ *     hash     linear-probing hash table lookups of long keys
+ *     tiled    the tiled transpose of trans-parallel.c, on one thread
+ *
+ * Each kernel describes its operands with an operand_t (cachelab.h);
+ * the helpers at the end lay them out in an arena, initialize them and
+ * check the outputs against the kernel's reference implementation.
+ */
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "cachelab.h"
+#include "kernels.h"
+#include "trans-parallel.h"
+
+/* Seed of the inputs, the same for every run */
+#define KERNEL_SEED 1
+
+static int min(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+/*
+ * matmul - C = A B, where A is N x M, B is M x N and C is N x N. The
+ *     loops are blocked so that a block of each matrix stays cached.
+ */
+#define MATMUL_BLOCK 8
+
+static void matmul_shape(int M, int N, operand_t ops[])
+{
+    ops[0].rows = N, ops[0].cols = M;
+    ops[1].rows = M, ops[1].cols = N;
+    ops[2].rows = N, ops[2].cols = N;
+}
+
+static void matmul_run(int M, int N, void *ops[])
+{
+    double (*A)[M] = ops[0], (*B)[N] = ops[1], (*C)[N] = ops[2];
+    int i, j, k, ii, jj, kk;
+
+    for (ii = 0; ii < N; ii += MATMUL_BLOCK)
+        for (kk = 0; kk < M; kk += MATMUL_BLOCK)
+            for (jj = 0; jj < N; jj += MATMUL_BLOCK)
+                for (i = ii; i < min(ii + MATMUL_BLOCK, N); i++)
+                    for (k = kk; k < min(kk + MATMUL_BLOCK, M); k++) {
+                        double a = A[i][k];
+                        for (j = jj; j < min(jj + MATMUL_BLOCK, N); j++)
+                            C[i][j] += a * B[k][j];
+                    }
+}
+
+static void matmul_reference(int M, int N, void *ops[])
+{
+    double (*A)[M] = ops[0], (*B)[N] = ops[1], (*C)[N] = ops[2];
+    int i, j, k;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++) {
+            double sum = 0;
+            for (k = 0; k < M; k++)
+                sum += A[i][k] * B[k][j];
+            C[i][j] = sum;
+        }
+}
+
+static const kernel_t matmul_kernel = {
+    "matmul", "Blocked matrix multiply (double)", 3,
+    {{"A", ELEM_DOUBLE, OPERAND_IN}, {"B", ELEM_DOUBLE, OPERAND_IN},
+     {"C", ELEM_DOUBLE, OPERAND_OUT}},
+    matmul_shape, NULL, matmul_run, matmul_reference
+};
+
+/*
+ * stencil - One Jacobi step of the 5-point stencil on an N x M grid. The
+ *     border is copied unchanged.
+ */
+static void grid_shape(int M, int N, operand_t ops[])
+{
+    ops[0].rows = ops[1].rows = N;
+    ops[0].cols = ops[1].cols = M;
+}
+
+static void stencil_run(int M, int N, void *ops[])
+{
+    float (*in)[M] = ops[0], (*out)[M] = ops[1];
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++) {
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                out[i][j] = in[i][j];
+            else
+                out[i][j] = 0.2f * (in[i][j] + in[i - 1][j] + in[i + 1][j] +
+                                    in[i][j - 1] + in[i][j + 1]);
+        }
+}
+
+/* The whole grid copied, then the inner points averaged over their neighbourhood */
+static void stencil_reference(int M, int N, void *ops[])
+{
+    float (*in)[M] = ops[0], (*out)[M] = ops[1];
+    int i, j, di, dj;
+
+    memcpy(out, in, (size_t)M * N * sizeof(float));
+    for (i = 1; i < N - 1; i++)
+        for (j = 1; j < M - 1; j++) {
+            float sum = 0;
+            for (di = -1; di <= 1; di++)
+                for (dj = -1; dj <= 1; dj++)
+                    if (di == 0 || dj == 0)
+                        sum += in[i + di][j + dj];
+            out[i][j] = sum / 5;
+        }
+}
+
+static const kernel_t stencil_kernel = {
+    "stencil", "5-point 2D stencil (float)", 2,
+    {{"in", ELEM_FLOAT, OPERAND_IN}, {"out", ELEM_FLOAT, OPERAND_OUT}},
+    grid_shape, NULL, stencil_run, stencil_reference
+};
+
+/*
+ * gather and scatter - Indirect copies of the M*N doubles of an N x M
+ *     array through an N x M array of int indices
+ */
+static void indirect_shape(int M, int N, operand_t ops[])
+{
+    int k;
+    for (k = 0; k < 3; k++)
+        ops[k].rows = N, ops[k].cols = M;
+}
+
+static void gather_init(int M, int N, void *ops[])
+{
+    int *idx = ops[1];
+    int i;
+
+    for (i = 0; i < M * N; i++)
+        idx[i] = rand() % (M * N);
+}
+
+static void gather_run(int M, int N, void *ops[])
+{
+    double *src = ops[0], *out = ops[2];
+    int *idx = ops[1];
+    int i;
+
+    for (i = 0; i < M * N; i++)
+        out[i] = src[idx[i]];
+}
+
+/* Each element of out, by row and column, from the row and column its index names */
+static void gather_reference(int M, int N, void *ops[])
+{
+    double (*src)[M] = ops[0], (*out)[M] = ops[2];
+    int (*idx)[M] = ops[1];
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            out[i][j] = src[idx[i][j] / M][idx[i][j] % M];
+}
+
+static const kernel_t gather_kernel = {
+    "gather", "Gather with random indices (double)", 3,
+    {{"src", ELEM_DOUBLE, OPERAND_IN}, {"idx", ELEM_INT, OPERAND_IN},
+     {"out", ELEM_DOUBLE, OPERAND_OUT}},
+    indirect_shape, gather_init, gather_run, gather_reference
+};
+
+/* A random permutation, so that no two elements are scattered to one place */
+static void scatter_init(int M, int N, void *ops[])
+{
+    int *idx = ops[1];
+    int i, j, tmp;
+
+    for (i = 0; i < M * N; i++)
+        idx[i] = i;
+    for (i = M * N - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = idx[i], idx[i] = idx[j], idx[j] = tmp;
+    }
+}
+
+static void scatter_run(int M, int N, void *ops[])
+{
+    double *src = ops[0], *dst = ops[2];
+    int *idx = ops[1];
+    int i;
+
+    for (i = 0; i < M * N; i++)
+        dst[idx[i]] = src[i];
+}
+
+/*
+ * Each element of dst pulled from the element of src the inverse
+ * permutation names. An element nothing is scattered to is left alone.
+ */
+static void scatter_reference(int M, int N, void *ops[])
+{
+    double *src = ops[0], *dst = ops[2];
+    int *idx = ops[1];
+    int *from = malloc((size_t)M * N * sizeof(int));
+    int i;
+
+    for (i = 0; i < M * N; i++)
+        from[i] = -1;
+    for (i = 0; i < M * N; i++)
+        from[idx[i]] = i;
+    for (i = 0; i < M * N; i++)
+        if (from[i] >= 0)
+            dst[i] = src[from[i]];
+    free(from);
+}
+
+static const kernel_t scatter_kernel = {
+    "scatter", "Scatter with a random permutation (double)", 3,
+    {{"src", ELEM_DOUBLE, OPERAND_IN}, {"idx", ELEM_INT, OPERAND_IN},
+     {"dst", ELEM_DOUBLE, OPERAND_OUT}},
+    indirect_shape, scatter_init, scatter_run, scatter_reference
+};
+
+/*
+ * hash - Look up M*N long keys in an open-addressing table of 2*M*N
+ *     slots with linear probing. Half of the keys are in the table. The
+ *     result of a lookup is the slot of the key, or -1. Key 0 marks an
+ *     empty slot.
+ */
+static void hash_shape(int M, int N, operand_t ops[])
+{
+    ops[0].rows = 2 * N, ops[0].cols = M;
+    ops[1].rows = N, ops[1].cols = M;
+    ops[2].rows = N, ops[2].cols = M;
+}
+
+static int hash_slot(long key, int slots)
+{
+    return ((unsigned long)key * 0x9e3779b97f4a7c15UL >> 32) % slots;
+}
+
+static void hash_init(int M, int N, void *ops[])
+{
+    long *table = ops[0], *keys = ops[1];
+    int slots = 2 * M * N;
+    int i, slot;
+
+    memset(table, 0, slots * sizeof(long));
+    for (i = 0; i < M * N; i++) {
+        keys[i] = ((long)rand() << 31 | rand()) + 1;
+        if (i % 2 == 0) {
+            for (slot = hash_slot(keys[i], slots); table[slot] != 0;
+                 slot = (slot + 1) % slots)
+                ;
+            table[slot] = keys[i];
+        }
+    }
+}
+
+static void hash_run(int M, int N, void *ops[])
+{
+    long *table = ops[0], *keys = ops[1];
+    int *out = ops[2];
+    int slots = 2 * M * N;
+    int i, slot;
+
+    for (i = 0; i < M * N; i++) {
+        slot = hash_slot(keys[i], slots);
+        while (table[slot] != 0 && table[slot] != keys[i])
+            slot = slot + 1 < slots ? slot + 1 : 0;
+        out[i] = table[slot] != 0 ? slot : -1;
+    }
+}
+
+/*
+ * The probe sequence of each key walked by its distance from the home
+ * slot, up to the first empty slot or the whole table
+ */
+static void hash_reference(int M, int N, void *ops[])
+{
+    long *table = ops[0], *keys = ops[1];
+    int *out = ops[2];
+    int slots = 2 * M * N;
+    int i, distance;
+
+    for (i = 0; i < M * N; i++) {
+        int home = hash_slot(keys[i], slots);
+        out[i] = -1;
+        for (distance = 0; distance < slots; distance++) {
+            long key = table[(home + distance) % slots];
+            if (key == 0)
+                break;
+            if (key == keys[i]) {
+                out[i] = (home + distance) % slots;
+                break;
+            }
+        }
+    }
+}
+
+static const kernel_t hash_kernel = {
+    "hash", "Hash table probe (long keys)", 3,
+    {{"table", ELEM_LONG, OPERAND_IN}, {"keys", ELEM_LONG, OPERAND_IN},
+     {"out", ELEM_INT, OPERAND_OUT}},
+    hash_shape, hash_init, hash_run, hash_reference
+};
+
+/*
+ * tiled - B = A^T with the tiled transpose of trans-parallel.c, on one
+ *     thread since the simulator models a single cache. bench-trans
+ *     measures how it scales over threads on large matrices.
+ */
+static void transpose_shape(int M, int N, operand_t ops[])
+{
+    ops[0].rows = N, ops[0].cols = M;
+    ops[1].rows = M, ops[1].cols = N;
+}
+
+static void tiled_run(int M, int N, void *ops[])
+{
+    trans_parallel(M, N, ops[0], ops[1], 1);
+}
+
+static void transpose_reference(int M, int N, void *ops[])
+{
+    int (*A)[M] = ops[0], (*B)[N] = ops[1];
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            B[j][i] = A[i][j];
+}
+
+static const kernel_t tiled_kernel = {
+    "tiled", "Tiled transpose with streaming stores (trans-parallel.c)", 2,
+    {{"A", ELEM_INT, OPERAND_IN}, {"B", ELEM_INT, OPERAND_OUT}},
+    transpose_shape, NULL, tiled_run, transpose_reference
+};
+
+void registerKernels(void)
+{
+    registerKernel(&matmul_kernel);
+    registerKernel(&stencil_kernel);
+    registerKernel(&gather_kernel);
+    registerKernel(&scatter_kernel);
+    registerKernel(&hash_kernel);
+    registerKernel(&tiled_kernel);
+}
+
+/*
+ * The helpers used by tracegen and test-trans for any registered kernel
+ */
+
+int kernelElemSize(elem_type_t type)
+{
+    static const int sizes[] = {sizeof(char), sizeof(short), sizeof(int),
+                                sizeof(long), sizeof(float), sizeof(double)};
+    return sizes[type];
+}
+
+unsigned long kernelLayout(const kernel_t *kernel, int M, int N,
+                           operand_t ops[], unsigned long base[])
+{
+    unsigned long offset = 0;
+    int k;
+
+    memcpy(ops, kernel->operands, sizeof(kernel->operands));
+    kernel->shape(M, N, ops);
+    for (k = 0; k < kernel->num_operands; k++) {
+        base[k] = KERNEL_ARENA + offset;
+        offset += (unsigned long)ops[k].rows * ops[k].cols * kernelElemSize(ops[k].type);
+        offset = (offset + KERNEL_ALIGN - 1) & ~(KERNEL_ALIGN - 1UL);
+    }
+    return offset;
+}
+
+/* Fill an operand with random elements */
+static void random_fill(const operand_t *op, void *ptr)
+{
+    long i, n = (long)op->rows * op->cols;
+
+    for (i = 0; i < n; i++) {
+        switch (op->type) {
+        case ELEM_CHAR:   ((char *)ptr)[i] = rand(); break;
+        case ELEM_SHORT:  ((short *)ptr)[i] = rand(); break;
+        case ELEM_INT:    ((int *)ptr)[i] = rand(); break;
+        case ELEM_LONG:   ((long *)ptr)[i] = (long)rand() << 31 | rand(); break;
+        case ELEM_FLOAT:  ((float *)ptr)[i] = (float)rand() / RAND_MAX; break;
+        case ELEM_DOUBLE: ((double *)ptr)[i] = (double)rand() / RAND_MAX; break;
+        }
+    }
+}
+
+int kernelAlloc(const kernel_t *kernel, int M, int N, void *ptrs[])
+{
+    operand_t ops[MAX_OPERANDS];
+    unsigned long base[MAX_OPERANDS];
+    unsigned long bytes = kernelLayout(kernel, M, N, ops, base);
+    int k;
+
+    void *arena = mmap((void *)KERNEL_ARENA, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+        return -1;
+    if (arena != (void *)KERNEL_ARENA) {
+        munmap(arena, bytes);
+        return -1;
+    }
+    srand(KERNEL_SEED);
+    for (k = 0; k < kernel->num_operands; k++) {
+        ptrs[k] = (void *)base[k];
+        if (ops[k].role & OPERAND_IN)
+            random_fill(&ops[k], ptrs[k]);
+    }
+    if (kernel->init)
+        kernel->init(M, N, ptrs);
+    return 0;
+}
+
+void kernelFree(const kernel_t *kernel, int M, int N)
+{
+    operand_t ops[MAX_OPERANDS];
+    unsigned long base[MAX_OPERANDS];
+
+    munmap((void *)KERNEL_ARENA, kernelLayout(kernel, M, N, ops, base));
+}
+
+void **kernelSave(const kernel_t *kernel, int M, int N, void *ptrs[])
+{
+    operand_t ops[MAX_OPERANDS];
+    unsigned long base[MAX_OPERANDS];
+    void **saved = calloc(MAX_OPERANDS, sizeof(void *));
+    int k;
+
+    kernelLayout(kernel, M, N, ops, base);
+    for (k = 0; k < kernel->num_operands; k++) {
+        size_t bytes = (size_t)ops[k].rows * ops[k].cols * kernelElemSize(ops[k].type);
+        saved[k] = malloc(bytes);
+        memcpy(saved[k], ptrs[k], bytes);
+    }
+    return saved;
+}
+
+/* Element i of an operand, as a double */
+static double elem_value(elem_type_t type, const void *ptr, long i)
+{
+    switch (type) {
+    case ELEM_CHAR:   return ((const char *)ptr)[i];
+    case ELEM_SHORT:  return ((const short *)ptr)[i];
+    case ELEM_INT:    return ((const int *)ptr)[i];
+    case ELEM_LONG:   return ((const long *)ptr)[i];
+    case ELEM_FLOAT:  return ((const float *)ptr)[i];
+    case ELEM_DOUBLE: return ((const double *)ptr)[i];
+    }
+    return 0;
+}
+
+int kernelValidate(int fn, const kernel_t *kernel, int M, int N,
+                   void *ptrs[], void **saved)
+{
+    operand_t ops[MAX_OPERANDS];
+    unsigned long base[MAX_OPERANDS];
+    int k, correct = 1;
+    long i;
+
+    kernelLayout(kernel, M, N, ops, base);
+    kernel->reference(M, N, saved);
+    for (k = 0; k < kernel->num_operands && correct; k++) {
+        if (!(ops[k].role & OPERAND_OUT))
+            continue;
+        for (i = 0; i < (long)ops[k].rows * ops[k].cols; i++) {
+            if (ops[k].type == ELEM_LONG) {
+                /* longs don't all fit in a double */
+                correct = ((long *)ptrs[k])[i] == ((long *)saved[k])[i];
+            } else {
+                double got = elem_value(ops[k].type, ptrs[k], i);
+                double expected = elem_value(ops[k].type, saved[k], i);
+                double diff = got > expected ? got - expected : expected - got;
+                double scale = expected > 1 ? expected : expected < -1 ? -expected : 1;
+                correct = diff <= 1e-4 * scale;
+            }
+            if (!correct) {
+                printf("Validation failed on function %d (%s)! Expected %g but got %g at %s[%ld][%ld]\n",
+                       fn, kernel->name, elem_value(ops[k].type, saved[k], i),
+                       elem_value(ops[k].type, ptrs[k], i), ops[k].name,
+                       i / ops[k].cols, i % ops[k].cols);
+                break;
+            }
+        }
+    }
+    for (k = 0; k < kernel->num_operands; k++)
+        free(saved[k]);
+    free(saved);
+    return correct;
+}
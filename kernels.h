@@ -0,0 +1,54 @@
+/*
+ * kernels.h - Built-in kernels traced by test-trans -k, and the helpers
+ *     tracegen uses to lay out, initialize and check any registered kernel
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "cachelab.h"
+
+/*
+ * The operands of a kernel are carved out of one anonymous mapping at
+ * this fixed address, each one aligned to KERNEL_ALIGN. The address is
+ * below 4GB, where test-trans keeps the accesses of a trace, and fixed so
+ * that the traces are the same from one run to the next.
+ */
+#define KERNEL_ARENA 0x10000000UL
+#define KERNEL_ALIGN 64
+
+/* Register the built-in kernels */
+void registerKernels(void);
+
+/* Size in bytes of an element of the given type */
+int kernelElemSize(elem_type_t type);
+
+/*
+ * kernelLayout - Copy the operands of kernel into ops, shaped for -M M
+ *     -N N, and set the address of each one in base. Returns the bytes of
+ *     the arena.
+ */
+unsigned long kernelLayout(const kernel_t *kernel, int M, int N,
+                           operand_t ops[], unsigned long base[]);
+
+/*
+ * kernelAlloc - Map the arena and point ptrs at the operands. The inputs
+ *     are initialized (with a fixed seed, so data-dependent kernels give
+ *     the same trace every time) and the outputs are zero. Returns 0 on
+ *     success, -1 if the arena can't be mapped at KERNEL_ARENA.
+ */
+int kernelAlloc(const kernel_t *kernel, int M, int N, void *ptrs[]);
+void kernelFree(const kernel_t *kernel, int M, int N);
+
+/*
+ * kernelValidate - Run the reference implementation on a copy of the
+ *     inputs saved by kernelSave and compare its outputs with ptrs.
+ *     Floating point outputs may differ by a relative 1e-4, since a
+ *     kernel may sum in another order than its reference. Returns 1 if
+ *     they match, otherwise prints the first mismatch and returns 0.
+ */
+void **kernelSave(const kernel_t *kernel, int M, int N, void *ptrs[]);
+int kernelValidate(int fn, const kernel_t *kernel, int M, int N,
+                   void *ptrs[], void **saved);
+
+#endif /* KERNELS_H */
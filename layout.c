@@ -0,0 +1,149 @@
+/*
+ * layout.c - Alternative data layouts of the traced matrices.
+ *
+ * The transpose functions index A and B as int[N][M] and the kernels
+ * index their operands row-major, so neither can be run on a padded,
+ * tiled or Z-ordered matrix. Their element order does not depend on the
+ * layout though, so test-trans gets the trace of a layout by rewriting
+ * the address of every element of the traced trace (layoutMap):
+ *
+ *     row      element (r,c) at r * (cols + pad) + c
+ *     tiled:t  t x t tiles in row-major order, row-major inside a tile,
+ *              each tile followed by pad unused elements
+ *     morton   the bits of r and c interleaved, c in the low bit
+ *
+ * The operands are aligned and may be further apart than they need to
+ * (offset), which moves one operand's sets against another's.
+ */
+#define _POSIX_C_SOURCE 200809L /* strdup, strtok_r */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cachelab.h"
+#include "kernels.h"
+#include "layout.h"
+
+int layoutParse(layout_t *layout, const char *spec)
+{
+    char *copy = strdup(spec), *field, *save = NULL;
+    int ok = 1;
+
+    memset(layout, 0, sizeof(*layout));
+    layout->align = KERNEL_ALIGN;
+    field = strtok_r(copy, ",", &save);
+    if (field == NULL)
+        ok = 0;
+    else if (strcmp(field, "row") == 0)
+        layout->order = LAYOUT_ROW;
+    else if (strcmp(field, "morton") == 0)
+        layout->order = LAYOUT_MORTON;
+    else if (sscanf(field, "tiled:%d", &layout->tile) == 1 && layout->tile > 0)
+        layout->order = LAYOUT_TILED;
+    else
+        ok = 0;
+    while (ok && (field = strtok_r(NULL, ",", &save)) != NULL) {
+        if (sscanf(field, "pad=%d", &layout->pad) == 1)
+            ok = layout->pad >= 0 && layout->order != LAYOUT_MORTON;
+        else if (sscanf(field, "align=%lu", &layout->align) == 1)
+            ok = layout->align > 0 && (layout->align & (layout->align - 1)) == 0;
+        else if (sscanf(field, "offset=%lu", &layout->offset) != 1)
+            ok = 0;
+    }
+    free(copy);
+    return ok ? 0 : -1;
+}
+
+/* Smallest power of 2 that is at least n */
+static unsigned long power_of_2(unsigned long n)
+{
+    unsigned long p = 1;
+
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+/* The bits of x spread out to the even bits */
+static unsigned long long spread_bits(unsigned long x)
+{
+    unsigned long long z = 0;
+    int bit;
+
+    for (bit = 0; bit < 32; bit++)
+        z |= (unsigned long long)((x >> bit) & 1) << (2 * bit);
+    return z;
+}
+
+/* Tiles along the rows and the columns of op */
+static unsigned long tiles(unsigned long n, int tile)
+{
+    return (n + tile - 1) / tile;
+}
+
+unsigned long layoutBytes(const layout_t *layout, const operand_t *op)
+{
+    unsigned long elements, side, tile = layout->tile;
+
+    switch (layout->order) {
+    case LAYOUT_TILED:
+        elements = tiles(op->rows, tile) * tiles(op->cols, tile) * (tile * tile + layout->pad);
+        break;
+    case LAYOUT_MORTON:
+        side = power_of_2(op->rows > op->cols ? op->rows : op->cols);
+        elements = side * side;
+        break;
+    default:
+        elements = (unsigned long)op->rows * (op->cols + layout->pad);
+        break;
+    }
+    return elements * kernelElemSize(op->type);
+}
+
+void layoutPlace(layout_t *layout, int n, const operand_t ops[],
+                 const unsigned long base[])
+{
+    unsigned long next = LAYOUT_BASE;
+    int k;
+
+    layout->num_operands = n;
+    for (k = 0; k < n; k++) {
+        layout->ops[k] = ops[k];
+        layout->base[k] = base[k];
+        next = (next + layout->align - 1) & ~(layout->align - 1);
+        if (k > 0)
+            next += layout->offset;
+        layout->new_base[k] = next;
+        next += layoutBytes(layout, &ops[k]);
+    }
+}
+
+unsigned long long layoutMap(const layout_t *layout, unsigned long long addr)
+{
+    int k;
+
+    for (k = 0; k < layout->num_operands; k++) {
+        const operand_t *op = &layout->ops[k];
+        unsigned long size = kernelElemSize(op->type);
+        unsigned long long end = layout->base[k] + (unsigned long long)op->rows * op->cols * size;
+        if (addr < layout->base[k] || addr >= end)
+            continue;
+
+        unsigned long long element = (addr - layout->base[k]) / size;
+        unsigned long r = element / op->cols, c = element % op->cols, tile = layout->tile;
+        unsigned long long index;
+        switch (layout->order) {
+        case LAYOUT_TILED:
+            index = ((r / tile) * tiles(op->cols, tile) + c / tile) * (tile * tile + layout->pad) +
+                (r % tile) * tile + c % tile;
+            break;
+        case LAYOUT_MORTON:
+            index = spread_bits(r) << 1 | spread_bits(c);
+            break;
+        default:
+            index = r * (op->cols + layout->pad) + c;
+            break;
+        }
+        return layout->new_base[k] + index * size + (addr - layout->base[k]) % size;
+    }
+    return addr;
+}
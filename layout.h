@@ -0,0 +1,62 @@
+/*
+ * layout.h - Alternative data layouts of the traced matrices, explored
+ *     with test-trans -L
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "cachelab.h"
+
+/*
+ * A layout moves the operands of a traced function out of the place
+ * tracegen gave them: the addresses of the trace that fall inside an
+ * operand are rewritten to where the layout stores that element. The
+ * operands are placed one after the other from LAYOUT_BASE, below 4GB
+ * like every address of a trace and away from tracegen's own data.
+ */
+#define LAYOUT_BASE 0x20000000UL
+
+#define LAYOUT_ROW    0 /* row-major, with an optional leading dimension */
+#define LAYOUT_TILED  1 /* row-major tiles of tile x tile elements */
+#define LAYOUT_MORTON 2 /* Z-order of the row and column bits */
+
+typedef struct layout {
+    int order;              /* LAYOUT_ROW, LAYOUT_TILED or LAYOUT_MORTON */
+    int tile;               /* edge of a tile */
+    int pad;                /* unused elements after each row, or each tile */
+    unsigned long align;    /* alignment of each operand in bytes */
+    unsigned long offset;   /* bytes skipped before each operand after the first */
+    /* Set by layoutPlace */
+    int num_operands;
+    operand_t ops[MAX_OPERANDS];
+    unsigned long base[MAX_OPERANDS];     /* where the operands were traced */
+    unsigned long new_base[MAX_OPERANDS]; /* where the layout puts them */
+} layout_t;
+
+/*
+ * layoutParse - Parse "<order>[,pad=<elems>][,align=<bytes>][,offset=<bytes>]"
+ *     where the order is row, tiled:<tile> or morton, e.g.
+ *     "row,pad=8,offset=32". The alignment defaults to KERNEL_ALIGN and
+ *     must be a power of 2; a Morton layout has no padding. Returns 0 on
+ *     success, -1 on a malformed spec.
+ */
+int layoutParse(layout_t *layout, const char *spec);
+
+/*
+ * layoutPlace - Place the n operands traced (row-major, contiguous) at
+ *     base[] in the layout, in order from LAYOUT_BASE
+ */
+void layoutPlace(layout_t *layout, int n, const operand_t ops[],
+                 const unsigned long base[]);
+
+/* Bytes an operand takes in the layout */
+unsigned long layoutBytes(const layout_t *layout, const operand_t *op);
+
+/*
+ * layoutMap - The address of a traced access in the layout. Accesses
+ *     outside the operands keep their address.
+ */
+unsigned long long layoutMap(const layout_t *layout, unsigned long long addr);
+
+#endif /* LAYOUT_H */
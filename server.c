@@ -0,0 +1,267 @@
+/*
+ * server.c - Unix socket transport of the cache simulator daemon.
+ *
+ * The daemon is a single thread polling the listening socket and its
+ * clients. Every client has a buffer the bytes it sends are appended to,
+ * and each complete request in it is handled and replied to before the
+ * next poll, so a client that sends half a request never blocks the others.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+#define HEADER_SIZE 8
+
+struct Client {
+    int fd;
+    unsigned char *buffer;
+    unsigned long length;
+    unsigned long capacity;
+};
+
+void server_put_record(unsigned char *record, char operation,
+                       unsigned long address, int size)
+{
+    unsigned int size32 = size;
+
+    memcpy(record, &address, 8);
+    memcpy(record + 8, &size32, 4);
+    record[12] = operation;
+    memset(record + 13, 0, 3);
+}
+
+void server_get_record(const unsigned char *record, char *operation,
+                       unsigned long *address, int *size)
+{
+    unsigned int size32;
+
+    memcpy(address, record, 8);
+    memcpy(&size32, record + 8, 4);
+    *size = size32;
+    *operation = record[12];
+}
+
+/* Write all of buffer, -1 if the connection failed */
+static int write_all(int fd, const void *buffer, unsigned long length)
+{
+    const unsigned char *bytes = buffer;
+
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written <= 0)
+            return -1;
+        bytes += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/* Read exactly length bytes, -1 if the connection closed first */
+static int read_all(int fd, void *buffer, unsigned long length)
+{
+    unsigned char *bytes = buffer;
+
+    while (length > 0) {
+        ssize_t got = read(fd, bytes, length);
+        if (got <= 0)
+            return -1;
+        bytes += got;
+        length -= got;
+    }
+    return 0;
+}
+
+static int unix_address(const char *path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path))
+        return -1;
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+int server_listen(const char *path)
+{
+    struct sockaddr_un address;
+    int fd;
+
+    if (unix_address(path, &address) < 0)
+        return -1;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, SERVER_MAX_CLIENTS) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_connect(const char *path)
+{
+    struct sockaddr_un address;
+    int fd;
+
+    if (unix_address(path, &address) < 0)
+        return -1;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_call(int fd, int type, const char *name, const void *payload,
+                unsigned long length, struct ServerReply *reply)
+{
+    unsigned char header[HEADER_SIZE] = {0};
+    unsigned int length32 = length;
+    unsigned long name_length = strlen(name);
+
+    if (name_length == 0 || name_length > SERVER_MAX_NAME ||
+        length > SERVER_MAX_PAYLOAD)
+        return -1;
+    header[0] = type;
+    header[1] = name_length;
+    header[2] = SERVER_VERSION;
+    memcpy(header + 4, &length32, 4);
+    if (write_all(fd, header, HEADER_SIZE) < 0 ||
+        write_all(fd, name, name_length) < 0 ||
+        write_all(fd, payload, length) < 0)
+        return -1;
+    if (read_all(fd, header, HEADER_SIZE) < 0)
+        return -1;
+    reply->status = header[0];
+    memcpy(&length32, header + 4, 4);
+    if (length32 > sizeof(reply->payload))
+        return -1;
+    reply->length = length32;
+    return read_all(fd, reply->payload, reply->length);
+}
+
+/*
+ * Handle the complete requests at the start of a client's buffer and keep
+ * the partial one. Returns 1 if a handler asked to stop, -1 if the client
+ * sent a malformed request and must be dropped, 0 otherwise.
+ */
+static int serve_requests(struct Client *client,
+                          int (*handle)(const struct ServerRequest *,
+                                        struct ServerReply *))
+{
+    struct ServerRequest request;
+    struct ServerReply reply;
+    unsigned long done = 0;
+    int stop = 0;
+
+    while (!stop && client->length - done >= HEADER_SIZE) {
+        const unsigned char *header = client->buffer + done;
+        unsigned int length32;
+        memcpy(&length32, header + 4, 4);
+        if (header[1] == 0 || length32 > SERVER_MAX_PAYLOAD)
+            return -1;
+        unsigned long size = HEADER_SIZE + header[1] + (unsigned long)length32;
+        if (client->length - done < size)
+            break;
+        request.type = header[0];
+        memcpy(request.name, header + HEADER_SIZE, header[1]);
+        request.name[header[1]] = '\0';
+        request.payload = header + HEADER_SIZE + header[1];
+        request.length = length32;
+        reply.status = SERVER_OK;
+        reply.length = 0;
+        /* the records of another version would be misread */
+        if (header[2] != SERVER_VERSION)
+            reply.status = SERVER_BAD_VERSION;
+        else
+            stop = handle(&request, &reply);
+
+        unsigned char reply_header[HEADER_SIZE] = {0};
+        length32 = reply.length;
+        reply_header[0] = reply.status;
+        memcpy(reply_header + 4, &length32, 4);
+        if (write_all(client->fd, reply_header, HEADER_SIZE) < 0 ||
+            write_all(client->fd, reply.payload, reply.length) < 0)
+            return -1;
+        done += size;
+    }
+    memmove(client->buffer, client->buffer + done, client->length - done);
+    client->length -= done;
+    return stop;
+}
+
+void server_loop(int listen_fd,
+                 int (*handle)(const struct ServerRequest *request,
+                               struct ServerReply *reply))
+{
+    struct Client clients[SERVER_MAX_CLIENTS];
+    struct pollfd fds[SERVER_MAX_CLIENTS + 1];
+    int count = 0;
+    int stop = 0;
+
+    while (!stop) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < count; ++i) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds, count + 1, -1) < 0)
+            continue;
+
+        for (int i = count - 1; i >= 0 && !stop; --i) {
+            struct Client *client = &clients[i];
+            int status = 0;
+            if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            /* make room for at least one more header or the rest of the request */
+            unsigned long wanted = client->length + 65536;
+            if (wanted > client->capacity) {
+                client->capacity = wanted > 2 * client->capacity ? wanted : 2 * client->capacity;
+                client->buffer = realloc(client->buffer, client->capacity);
+            }
+            ssize_t got = read(client->fd, client->buffer + client->length,
+                               client->capacity - client->length);
+            if (got <= 0)
+                status = -1;
+            else {
+                client->length += got;
+                status = serve_requests(client, handle);
+            }
+            if (status < 0) {
+                close(client->fd);
+                free(client->buffer);
+                clients[i] = clients[--count];
+            }
+            stop = status > 0;
+        }
+
+        if (!stop && (fds[0].revents & POLLIN)) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0 && count == SERVER_MAX_CLIENTS)
+                close(fd);
+            else if (fd >= 0) {
+                clients[count].fd = fd;
+                clients[count].buffer = NULL;
+                clients[count].length = 0;
+                clients[count].capacity = 0;
+                count++;
+            }
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        close(clients[i].fd);
+        free(clients[i].buffer);
+    }
+}
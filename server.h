@@ -0,0 +1,96 @@
+/*
+ * server.h - Unix socket protocol of the cache simulator daemon (csim --server)
+ *
+ * A client sends requests and gets one reply for each. A request is an
+ * 8-byte header followed by the name of the cache and the payload:
+ *
+ *     byte 0     message type (SERVER_MSG_*)
+ *     byte 1     length of the name, 1 to SERVER_MAX_NAME
+ *     byte 2     SERVER_VERSION, the version of the protocol of the client
+ *     byte 3     reserved, 0
+ *     bytes 4-7  length of the payload
+ *
+ * A reply is an 8-byte header (status, 3 reserved bytes, length of the
+ * payload) followed by its payload. Integers are in the native byte order,
+ * the socket only connects processes of the same machine.
+ */
+
+#ifndef CSIM_SERVER_H
+#define CSIM_SERVER_H
+
+/* Version 2 widened the size of an access record to 4 bytes */
+#define SERVER_VERSION 2
+
+#define SERVER_MAX_NAME 255
+#define SERVER_MAX_PAYLOAD (1 << 24)
+#define SERVER_MAX_CLIENTS 64
+
+/* Request types */
+#define SERVER_MSG_OPEN 1     /* payload: s, E, b, 4 bytes each; creates the cache unless it exists */
+#define SERVER_MSG_ACCESS 2   /* payload: access records, see below */
+#define SERVER_MSG_STATS 3    /* reply payload: SERVER_STATS counters */
+#define SERVER_MSG_RESET 4    /* zero the counters, the cache keeps its contents */
+#define SERVER_MSG_CLOSE 5    /* drop the cache */
+#define SERVER_MSG_SHUTDOWN 6 /* stop the daemon */
+
+/* Reply status */
+#define SERVER_OK 0
+#define SERVER_NO_CACHE 1     /* no cache of that name, OPEN it first */
+#define SERVER_BAD_GEOMETRY 2 /* invalid geometry, or the cache exists with another one */
+#define SERVER_BAD_REQUEST 3
+#define SERVER_BAD_VERSION 4  /* the client speaks another version of the protocol */
+
+/*
+ * An access record: the address (8 bytes), the size (4 bytes), the
+ * operation ('L', 'S' or 'M') and 3 reserved bytes.
+ */
+#define SERVER_RECORD_SIZE 16
+
+/*
+ * The STATS reply is this many 8-byte counters: hits, misses, evictions,
+ * dirty bytes evicted, dirty bytes active, double references, and the
+ * cycles of the latency model (0 when the daemon runs without -l)
+ */
+#define SERVER_STATS 7
+
+struct ServerRequest {
+    int type;
+    char name[SERVER_MAX_NAME + 1];
+    const unsigned char *payload;
+    unsigned long length;
+};
+
+struct ServerReply {
+    int status;
+    unsigned char payload[8 * SERVER_STATS];
+    unsigned long length;
+};
+
+void server_put_record(unsigned char *record, char operation,
+                       unsigned long address, int size);
+void server_get_record(const unsigned char *record, char *operation,
+                       unsigned long *address, int *size);
+
+/* Create the socket at path (replacing a stale one) and listen on it, -1 on error */
+int server_listen(const char *path);
+
+/*
+ * server_loop - Serve the clients of the listening socket until handle
+ *     returns nonzero. handle fills the reply of every complete request,
+ *     the requests of one client are handled in order.
+ */
+void server_loop(int listen_fd,
+                 int (*handle)(const struct ServerRequest *request,
+                               struct ServerReply *reply));
+
+/* Connect to the daemon listening at path, -1 on error */
+int server_connect(const char *path);
+
+/*
+ * server_call - Send a request and wait for its reply. Returns 0 on
+ *     success, -1 if the connection failed.
+ */
+int server_call(int fd, int type, const char *name, const void *payload,
+                unsigned long length, struct ServerReply *reply);
+
+#endif /* CSIM_SERVER_H */
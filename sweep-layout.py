@@ -0,0 +1,93 @@
+#!/usr/bin/env python
+#
+# sweep-layout.py - Sweep the data layouts of test-trans -L (row padding,
+#     base offsets, alignment, tiled and Morton order) and report the
+#     hits, misses and evictions of every registered function in each
+#     layout, next to the layout tracegen actually gave them.
+#
+#     Every layout replays the same traces, which test-trans keeps in
+#     .trans-cache, so only the first run of a function traces it.
+#
+import subprocess;
+import re;
+import os;
+import sys;
+import optparse;
+
+# The layouts swept when no -L is given
+LAYOUTS = ["row", "row,pad=1", "row,pad=8", "row,offset=32", "row,offset=544",
+           "tiled:4", "tiled:8", "tiled:8,pad=8", "morton", "morton,offset=544"]
+
+#
+# runTestTrans - Run ./test-trans in a layout (None for the traced one)
+# and return {function: (description, hits, misses, evictions)}
+#
+def runTestTrans(M, N, layout, kernels, use_cache):
+    cmd = ["./test-trans", "-M", str(M), "-N", str(N)]
+    if kernels:
+        cmd.append("-k")
+    if not use_cache:
+        cmd.append("-n")
+    if layout is not None:
+        cmd += ["-L", layout]
+    p = subprocess.Popen(cmd, stdout=subprocess.PIPE)
+    stdout_data = p.communicate()[0]
+    results = {}
+    for line in stdout_data.decode("utf-8").split("\n"):
+        m = re.match(r"func (\d+) \((.*)\): hits:(\d+), misses:(\d+), evictions:(\d+)", line)
+        if m:
+            results[int(m.group(1))] = (m.group(2), int(m.group(3)),
+                                        int(m.group(4)), int(m.group(5)))
+    if p.returncode != 0 or not results:
+        print("Error: ./test-trans %s failed" % " ".join(cmd[1:]))
+        sys.exit(1)
+    return results
+
+#
+# main - Main function
+#
+def main():
+    p = optparse.OptionParser(usage="%prog [options] -M <cols> -N <rows>")
+    p.add_option("-M", type="int", dest="M", help="matrix columns")
+    p.add_option("-N", type="int", dest="N", help="matrix rows")
+    p.add_option("-L", action="append", dest="layouts",
+                 help="layout to sweep, may be repeated (default: %s)"
+                      % " ".join(LAYOUTS))
+    p.add_option("-k", action="store_true", dest="kernels", default=False,
+                 help="also sweep the built-in kernels of kernels.c")
+    p.add_option("-n", action="store_false", dest="use_cache", default=True,
+                 help="do not use the cached traces and results")
+    opts, args = p.parse_args()
+    if opts.M is None or opts.N is None:
+        p.print_help()
+        sys.exit(1)
+    if not os.access("./test-trans", os.X_OK):
+        print("Error: ./test-trans is missing or not executable, run make")
+        sys.exit(1)
+
+    layouts = [None] + (opts.layouts or LAYOUTS)
+    sweep = []
+    for layout in layouts:
+        print("Simulating the %s layout" % (layout or "traced"))
+        sweep.append(runTestTrans(opts.M, opts.N, layout, opts.kernels,
+                                  opts.use_cache))
+
+    # One table per function, the fewest misses marked
+    best_layouts = []
+    for fn in sorted(sweep[0]):
+        rows = [(layouts[i], sweep[i][fn]) for i in range(len(layouts)) if fn in sweep[i]]
+        best = min(rows, key=lambda row: row[1][2])
+        best_layouts.append((fn, rows[0][1], best))
+        print("\nFunction %d (%s), %dx%d" % (fn, sweep[0][fn][0], opts.N, opts.M))
+        print("  %-24s%10s%10s%10s" % ("Layout", "Hits", "Misses", "Evictions"))
+        for layout, (desc, hits, misses, evictions) in rows:
+            print("  %-24s%10d%10d%10d%s" % (layout or "traced", hits, misses, evictions,
+                                             "  <- best" if misses == best[1][2] else ""))
+
+    print("\nBest layout per function:")
+    for fn, traced, (layout, result) in best_layouts:
+        print("  func %d (%s): %s, misses:%d (traced: %d)"
+              % (fn, traced[0], layout or "traced", result[2], traced[2]))
+
+if __name__ == "__main__":
+    main()
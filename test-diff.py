@@ -0,0 +1,512 @@
+#!/usr/bin/env python
+#
+# test-diff.py - Differential tester of the cache simulator. It runs
+#     ./csim and the reference simulator ./csim-ref on randomized traces
+#     and (s,E,b) geometries and compares the six counters of
+#     printSummary. It also times ./csim on a few long traces, appends
+#     the throughput to a history file and flags the cases that got
+#     slower than the median of their previous runs.
+#
+#     The optional models of ./csim have no counterpart in ./csim-ref, so
+#     each one is checked against the plain run of ./csim instead, on a
+#     few random cases: a model that must not change the counters has to
+#     give the same ones, and a run that hangs is killed and fails.
+#
+#     The cases only depend on the seed, so the same seed gives the same
+#     traces and geometries from one run to the next. Exits with status 1
+#     on a mismatch or a speed regression.
+#
+import subprocess;
+import random;
+import os;
+import sys;
+import time;
+import hashlib;
+import tempfile;
+import optparse;
+
+#
+# makeTrace - Write a random trace of n records to path. The addresses
+# mix a few working sets (some above 4GB), strided sweeps and reuse of
+# recent addresses, so every case sees hits, misses and evictions.
+#
+def makeTrace(path, rng, n):
+    bases = [rng.randrange(0, 1 << 24) for i in range(6)]
+    bases += [rng.randrange(1 << 32, 1 << 47) for i in range(2)]
+    span = rng.choice([256, 4096, 65536])
+    recent = [bases[0]]
+    stride = rng.choice([4, 8, 16, 64, 256])
+    sweep = rng.choice(bases)
+    with open(path, "w") as f:
+        for i in range(n):
+            op = rng.choice("LLLSSMI")
+            size = rng.choice([1, 2, 4, 8, 16])
+            pattern = rng.random()
+            if pattern < 0.3:
+                addr = rng.choice(recent)
+            elif pattern < 0.6:
+                addr = sweep
+                sweep += stride
+            else:
+                addr = rng.choice(bases) + rng.randrange(0, span)
+            recent.append(addr)
+            if len(recent) > 32:
+                recent.pop(0)
+            if op == 'I':
+                f.write("I %x,%d\n" % (addr, size))
+            else:
+                f.write(" %s %x,%d\n" % (op, addr, size))
+
+#
+# makeGeometry - A random (s,E,b). The reference simulator needs s > 0
+# and b > 0.
+#
+def makeGeometry(rng):
+    return (rng.randint(1, 10), rng.choice([1, 1, 2, 3, 4, 8, 16, 32]),
+            rng.randint(1, 7))
+
+#
+# runSimulator - Run a simulator on a trace, return its six counters
+# and the wall time of the run
+#
+def runSimulator(sim, geometry, trace):
+    s, E, b = geometry
+    cmd = [sim, "-s", str(s), "-E", str(E), "-b", str(b), "-t", trace]
+    start = time.time()
+    p = subprocess.Popen(cmd, stdout=subprocess.PIPE)
+    stdout_data = p.communicate()[0]
+    elapsed = time.time() - start
+    counters = None
+    for line in stdout_data.decode("utf-8").split("\n"):
+        if line.startswith("hits:"):
+            counters = [int(field.split(":")[1]) for field in line.split()]
+    if p.returncode != 0:
+        counters = None
+    return counters, elapsed
+
+#
+# runCsim - Run ./csim with args, killed after timeout seconds so that a
+# hang fails like a crash. Returns its exit status and the name:value
+# fields of each line of its output that has some, in order.
+#
+def runCsim(args, timeout=30):
+    p = subprocess.Popen(["timeout", str(timeout), "./csim"] + args,
+                         stdout=subprocess.PIPE)
+    stdout_data = p.communicate()[0]
+    lines = []
+    for line in stdout_data.decode("utf-8").split("\n"):
+        fields = dict(field.split(":", 1) for field in line.split() if ":" in field)
+        if fields:
+            lines.append(fields)
+    return p.returncode, lines
+
+#
+# summary - The six counters of printSummary in the output of runCsim
+#
+def summary(lines):
+    for fields in lines:
+        if "hits" in fields and "double_refs" in fields:
+            return [int(fields[name]) for name in ["hits", "misses",
+                    "evictions", "dirty_bytes_evicted", "dirty_bytes_active",
+                    "double_refs"]]
+    return None
+
+def geometryArgs(geometry):
+    s, E, b = geometry
+    return ["-s", str(s), "-E", str(E), "-b", str(b)]
+
+# The counters of the whole run and of each tenant
+def tenantCounts(lines):
+    return [(fields.get("tenant"), fields["hits"], fields["misses"], fields["evictions"])
+            for fields in lines if "hits" in fields]
+
+#
+# checkPartitioning - Way partitioning with every way allowed to every
+# tenant must count like the tenants sharing the cache, whether the masks
+# are given or left out, and a mask without any of the E ways must be
+# rejected rather than hang
+#
+def checkPartitioning(geometry, traces):
+    s, E, b = geometry
+    args = geometryArgs(geometry) + ["-t", traces[0], "--tenant", traces[1]]
+    status, shared = runCsim(args)
+    if status != 0:
+        return ["the shared run exited with %d" % status]
+    errors = []
+    all_ways = "%x" % ((1 << E) - 1)
+    for ways in [all_ways + "," + all_ways, all_ways]:
+        status, lines = runCsim(args + ["--ways", ways])
+        if status != 0:
+            errors.append("--ways %s exited with %d" % (ways, status))
+        elif tenantCounts(lines) != tenantCounts(shared):
+            errors.append("--ways %s does not count like the shared run" % ways)
+    status, lines = runCsim(args + ["--ways", all_ways + ",%x" % (1 << E)])
+    if status == 0 or status == 124:
+        errors.append("a mask without any of the %d ways was not rejected" % E)
+    return errors
+
+# The summary and the cycles of the latency model in the output of runCsim
+def timedSummary(lines):
+    cycles = [int(fields["cycles"]) for fields in lines if "cycles" in fields]
+    return summary(lines), cycles[0] if cycles else None
+
+#
+# checkServer - A trace replayed through the daemon must count like the
+# plain run, and a replay after --reset like the second half of the trace
+# run twice, cycles included. Accesses of 64KB and more must reach the
+# daemon with their size.
+#
+def checkServer(geometry, traces):
+    workdir = os.path.dirname(traces[0])
+    socket_path = os.path.join(workdir, "socket")
+    twice = os.path.join(workdir, "twice")
+    with open(twice, "w") as out:
+        for i in range(2):
+            with open(traces[0]) as f:
+                out.write(f.read())
+    daemon = subprocess.Popen(["./csim", "-l", "-z", "--server", socket_path],
+                              stdout=subprocess.PIPE)
+    for i in range(100):
+        if os.path.exists(socket_path):
+            break
+        time.sleep(0.05)
+    args = geometryArgs(geometry) + ["-t", traces[0], "--connect", socket_path]
+    errors = []
+    status, plain = runCsim(["-l", "-z"] + geometryArgs(geometry) + ["-t", traces[0]])
+    status, served = runCsim(args)
+    if timedSummary(served) != timedSummary(plain):
+        errors.append("the daemon counts %s, the plain run %s"
+                      % (timedSummary(served), timedSummary(plain)))
+    status, replay = runCsim(args + ["--reset"])
+    status, whole = runCsim(["-l", "-z"] + geometryArgs(geometry) + ["-t", twice])
+    (first, first_cycles), (both, both_cycles) = timedSummary(plain), timedSummary(whole)
+    if first is not None and both is not None:
+        expected = [both[i] - first[i] for i in range(6)]
+        expected[4] = both[4] # dirty bytes still cached, not a count
+        if timedSummary(replay) != (expected, both_cycles - first_cycles):
+            errors.append("after --reset the daemon counts %s, expected %s"
+                          % (timedSummary(replay), (expected, both_cycles - first_cycles)))
+    # accesses of 64KB and more, split by the daemon's -z like by a plain run
+    wide = os.path.join(workdir, "wide")
+    with open(wide, "w") as f:
+        f.write(" S 10000,70000\n L 10000,65536\n M 40000,131072\n L 7fff0000,1\n")
+    status, plain = runCsim(["-z"] + geometryArgs(geometry) + ["-t", wide])
+    status, served = runCsim(geometryArgs(geometry) + ["-t", wide, "--connect", socket_path,
+                                                       "--cache", "wide"])
+    if summary(served) != summary(plain):
+        errors.append("with -z the daemon counts %s for 64KB accesses, the plain run %s"
+                      % (summary(served), summary(plain)))
+    runCsim(["--connect", socket_path, "--shutdown"])
+    daemon.communicate()
+    os.remove(twice)
+    os.remove(wide)
+    return errors
+
+#
+# checkEventLog - The totals csim-log reads back from the event log of -v
+# must be the counters of the run that wrote it
+#
+def checkEventLog(geometry, traces):
+    s, E, b = geometry
+    log = os.path.join(os.path.dirname(traces[0]), "events")
+    status, lines = runCsim(["-v", "--log", log] + geometryArgs(geometry) + ["-t", traces[0]])
+    counters = summary(lines)
+    p = subprocess.Popen(["./csim-log", "-c", log], stdout=subprocess.PIPE)
+    totals = dict(field.split(":") for field in p.communicate()[0].decode("utf-8").split())
+    os.remove(log)
+    if status != 0 or p.returncode != 0:
+        return ["csim -v exited with %d, csim-log with %d" % (status, p.returncode)]
+    logged = [int(totals.get(name, -1)) for name in ["hits", "misses", "evictions"]]
+    logged.append(int(totals.get("dirty_writebacks", -1)) << b)
+    if logged != counters[:4]:
+        return ["csim-log totals %s, the run %s" % (logged, counters[:4])]
+    return []
+
+#
+# makeStrideTrace - Write a trace of long stride runs of loads and
+# stores, the records --runs counts in bulk, broken up by other accesses
+#
+def makeStrideTrace(path, rng, n):
+    with open(path, "w") as f:
+        while n > 0:
+            addr = rng.randrange(0, 1 << 24)
+            stride = rng.choice([1, 2, 4, 8, 64, 4096])
+            size = rng.choice([1, 4, 8])
+            op = rng.choice("LSM")
+            for i in range(min(n, rng.randint(1, 500))):
+                f.write(" %s %x,%d\n" % (op, addr + i * stride, size))
+                n -= 1
+
+#
+# checkRuns - Counting the stride runs in bulk must give the counters of
+# the plain run, with the kernel of the geometry and without it
+#
+def checkRuns(geometry, traces):
+    rng = random.Random(traces[0] + str(geometry))
+    strided = os.path.join(os.path.dirname(traces[0]), "strided")
+    makeStrideTrace(strided, rng, 20000)
+    errors = []
+    for trace in [traces[0], strided]:
+        for generic in [[], ["--generic"]]:
+            args = generic + geometryArgs(geometry) + ["-t", trace]
+            status, plain = runCsim(args)
+            status, bulk = runCsim(args + ["--runs"])
+            if status != 0 or summary(bulk) != summary(plain):
+                errors.append("--runs %s counts %s, the plain run %s"
+                              % (" ".join(generic), summary(bulk), summary(plain)))
+    os.remove(strided)
+    return errors
+
+#
+# checkDram - The DRAM model must not change the counters of the cache,
+# must read every missed block and write every dirty one back, and must
+# classify each request as one row buffer hit, empty row or conflict
+#
+def checkDram(geometry, traces):
+    s, E, b = geometry
+    args = geometryArgs(geometry) + ["-t", traces[0]]
+    status, plain = runCsim(args)
+    counters = summary(plain)
+    errors = []
+    for dram in [["-l", "--dram", "1:1:8"], ["--dram", "2:2:4", "--dram-xor"],
+                 ["-l", "--dram", "1:2:8", "--dram-page", "closed", "--dram-queue", "2"]]:
+        status, lines = runCsim(dram + args)
+        stats = [fields for fields in lines if "dram_reads" in fields]
+        if status != 0 or not stats:
+            errors.append("%s exited with %d" % (" ".join(dram), status))
+            continue
+        stats = dict((name, float(value)) for name, value in stats[0].items())
+        requests = stats["dram_reads"] + stats["dram_writes"]
+        if summary(lines) != counters:
+            errors.append("%s counts %s, the plain run %s" % (" ".join(dram),
+                          summary(lines), counters))
+        elif stats["dram_reads"] != counters[1] or int(stats["dram_writes"]) << b != counters[3]:
+            errors.append("%s reads %d and writes %d blocks for %d misses and %d dirty bytes"
+                          % (" ".join(dram), stats["dram_reads"], stats["dram_writes"],
+                             counters[1], counters[3]))
+        elif stats["row_hits"] + stats["row_empty"] + stats["row_conflicts"] != requests or \
+             ("closed" in dram and stats["row_hits"] != 0):
+            errors.append("%s classifies the %d requests as %d row hits, %d empty, %d conflicts"
+                          % (" ".join(dram), requests, stats["row_hits"], stats["row_empty"],
+                             stats["row_conflicts"]))
+    return errors
+
+#
+# checkBatch - Each trace of a --batch run must print the lines of its
+# own single run, with the same options
+#
+def checkBatch(geometry, traces):
+    manifest = os.path.join(os.path.dirname(traces[0]), "manifest")
+    with open(manifest, "w") as f:
+        f.write("\n".join(traces + [traces[0]]) + "\n")
+    errors = []
+    for options in [[], ["-l", "-z", "--run-stats"], ["--victim", "4", "--index", "xor"],
+                    ["--miss-cache", "2", "--generic", "--runs"]]:
+        args = options + geometryArgs(geometry)
+        status, lines = runCsim(args + ["--batch", manifest, "--jobs", "2"])
+        reports = []
+        for fields in lines:
+            if "trace" in fields:
+                reports.append([fields])
+            elif "batch_traces" not in fields and reports:
+                reports[-1].append(fields)
+        if status != 0 or len(reports) != 3:
+            errors.append("--batch %s exited with %d" % (" ".join(options), status))
+            continue
+        for trace, report in zip(traces + [traces[0]], reports):
+            status, single = runCsim(args + ["-t", trace])
+            counters, cycles = timedSummary(single)
+            single = [fields for fields in single if "cycles" not in fields]
+            if summary(report) != counters or report[1:] != single[1:] or \
+               ("-l" in options and int(report[0]["cycles"]) != cycles):
+                errors.append("--batch %s prints %s for %s, the single run %s"
+                              % (" ".join(options), report, trace, single))
+    os.remove(manifest)
+    return errors
+
+#
+# checkAttribution - The counts --attribute writes for its regions and
+# for the other accesses must add up to the counters of the run, which
+# must be those of the plain run
+#
+def checkAttribution(geometry, traces):
+    args = geometryArgs(geometry) + ["-t", traces[0]]
+    status, plain = runCsim(args)
+    with open(traces[0]) as f:
+        addresses = [int(line.split()[1].split(",")[0], 16) for line in f
+                     if line.startswith(" ")]
+    regions = []
+    for name in ["A", "B"]:
+        base = random.Random(name + traces[0]).choice(addresses) & ~7
+        regions += ["--attribute", "%s:%x:%d:8" % (name, base, 4096)]
+    status, lines = runCsim(args + regions)
+    totals = [0, 0, 0]
+    with open(".csim_attrib") as f:
+        for line in f:
+            for k in range(3):
+                totals[k] += int(line.split()[2 + k])
+    os.remove(".csim_attrib")
+    if status != 0 or summary(lines) != summary(plain):
+        return ["--attribute counts %s, the plain run %s" % (summary(lines), summary(plain))]
+    if totals != summary(lines)[:3]:
+        return ["the elements add up to %s, the run counts %s" % (totals, summary(lines)[:3])]
+    return []
+
+# The feature checks, each called with a geometry and two traces; returns
+# the mismatches it found
+FEATURES = [("way partitioning", checkPartitioning), ("daemon", checkServer),
+            ("event log", checkEventLog), ("stride runs", checkRuns),
+            ("DRAM", checkDram), ("batch", checkBatch),
+            ("attribution", checkAttribution)]
+
+def fileHash(path):
+    with open(path, "rb") as f:
+        return hashlib.sha1(f.read()).hexdigest()[:12]
+
+#
+# readHistory - Throughputs of the previous runs, by case and trace length
+#
+def readHistory(path):
+    history = {}
+    if not os.path.isfile(path):
+        return history
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) == 6:
+                key = (fields[2], int(fields[3]))
+                history.setdefault(key, []).append(float(fields[5]))
+    return history
+
+def median(values):
+    values = sorted(values)
+    return values[len(values) // 2]
+
+#
+# main - Main function
+#
+def main():
+    p = optparse.OptionParser()
+    p.add_option("-n", type="int", dest="cases", default=60,
+                 help="number of correctness cases (default 60)")
+    p.add_option("-r", type="int", dest="records", default=20000,
+                 help="maximum records of a correctness trace (default 20000)")
+    p.add_option("-p", type="int", dest="perf_cases", default=4,
+                 help="number of timed cases (default 4)")
+    p.add_option("-R", type="int", dest="perf_records", default=1000000,
+                 help="records of a timed trace (default 1000000)")
+    p.add_option("-f", type="int", dest="feature_cases", default=3,
+                 help="number of cases of each feature check (default 3)")
+    p.add_option("--seed", type="int", dest="seed", default=1,
+                 help="seed of the cases (default 1)")
+    p.add_option("--threshold", type="float", dest="threshold", default=0.2,
+                 help="flag a timed case this much slower than the median "
+                      "of its history (default 0.2)")
+    p.add_option("--history", dest="history", default=".csim_history",
+                 help="throughput history file (default .csim_history)")
+    p.add_option("--no-history", action="store_false", dest="record",
+                 default=True, help="do not append this run to the history")
+    opts, args = p.parse_args()
+
+    for sim in ["./csim", "./csim-ref", "./csim-log"]:
+        if not os.access(sim, os.X_OK):
+            print("Error: %s is missing or not executable, run make" % sim)
+            sys.exit(1)
+
+    workdir = tempfile.mkdtemp(prefix="csim-diff.")
+    trace = os.path.join(workdir, "trace")
+    failures = 0
+
+    # Correctness: every counter must match the reference
+    print("Comparing ./csim with ./csim-ref on %d random cases (seed %d)"
+          % (opts.cases, opts.seed))
+    for case in range(opts.cases):
+        rng = random.Random("%d:%d" % (opts.seed, case))
+        geometry = makeGeometry(rng)
+        n = rng.randint(1, opts.records)
+        makeTrace(trace, rng, n)
+        ref, ref_time = runSimulator("./csim-ref", geometry, trace)
+        got, got_time = runSimulator("./csim", geometry, trace)
+        if ref is None or got != ref:
+            failures += 1
+            kept = "csim-diff.%d.%d.trace" % (opts.seed, case)
+            os.rename(trace, kept)
+            print("MISMATCH case %d (s,E,b)=%s records=%d, trace kept in %s"
+                  % (case, geometry, n, kept))
+            print("  csim-ref: %s" % ref)
+            print("  csim:     %s" % got)
+    print("%d of %d cases match" % (opts.cases - failures, opts.cases))
+
+    # Features: each optional model against the plain run of ./csim
+    tenant_trace = os.path.join(workdir, "tenant")
+    print("")
+    for name, check in FEATURES:
+        errors = 0
+        for case in range(opts.feature_cases):
+            rng = random.Random("feature:%s:%d:%d" % (name, opts.seed, case))
+            geometry = makeGeometry(rng)
+            makeTrace(trace, rng, rng.randint(1, opts.records))
+            makeTrace(tenant_trace, rng, rng.randint(1, opts.records))
+            for error in check(geometry, [trace, tenant_trace]):
+                errors += 1
+                print("MISMATCH %s case %d (s,E,b)=%s: %s" % (name, case,
+                      geometry, error))
+        failures += errors
+        print("%-24s%s" % (name, "FAILED" if errors else "ok"))
+    os.remove(tenant_trace)
+
+    # Performance: best of three runs of each timed case
+    history = readHistory(opts.history)
+    version = fileHash("./csim")
+    now = int(time.time())
+    regressions = 0
+    lines = []
+    print("\n%-24s%10s%14s%14s  %s" % ("Timed case", "Records", "Records/s",
+                                        "Median", "Change"))
+    for case in range(opts.perf_cases):
+        rng = random.Random("perf:%d:%d" % (opts.seed, case))
+        geometry = makeGeometry(rng)
+        makeTrace(trace, rng, opts.perf_records)
+        best = None
+        for run in range(3):
+            counters, elapsed = runSimulator("./csim", geometry, trace)
+            if best is None or elapsed < best:
+                best = elapsed
+        ref, ref_time = runSimulator("./csim-ref", geometry, trace)
+        if counters != ref:
+            failures += 1
+            print("MISMATCH timed case %d (s,E,b)=%s" % (case, geometry))
+        name = "%d.%d:s%d,E%d,b%d" % ((opts.seed, case) + geometry)
+        rate = opts.perf_records / max(best, 1e-6)
+        previous = history.get((name, opts.perf_records), [])
+        change = ""
+        if previous:
+            baseline = median(previous[-10:])
+            change = "%+.1f%%" % (100.0 * (rate / baseline - 1))
+            if rate < baseline * (1 - opts.threshold):
+                regressions += 1
+                change += " SLOWER"
+        print("%-24s%10d%14.0f%14s  %s" % (name, opts.perf_records, rate,
+              "%.0f" % median(previous[-10:]) if previous else "-", change))
+        print("%-24s%10s%14.0f  (csim-ref)" % ("", "",
+              opts.perf_records / max(ref_time, 1e-6)))
+        lines.append("%d %s %s %d %.6f %.0f\n" % (now, version, name,
+                     opts.perf_records, best, rate))
+
+    if opts.record:
+        with open(opts.history, "a") as f:
+            f.writelines(lines)
+    if os.path.exists(trace):
+        os.remove(trace)
+    os.rmdir(workdir)
+
+    if regressions:
+        print("\n%d timed cases are more than %.0f%% slower than their history"
+              % (regressions, 100 * opts.threshold))
+    if failures or regressions:
+        sys.exit(1)
+    print("\nOK")
+
+# execute main only if called as a script
+if __name__ == "__main__":
+    main()
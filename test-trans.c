@@ -11,9 +11,12 @@
 #include <signal.h>
 #include <getopt.h>
 #include <sys/types.h>
+#include <sys/stat.h> // for mkdir
 #include "cachelab.h"
+#include "kernels.h"
+#include "layout.h"
 #include <sys/wait.h> // fir WEXITSTATUS
-#include <limits.h> // for INT_MAX
+#include <limits.h> // for LLONG_MAX
 
 /* Maximum array dimension */
 #define MAXN 256
@@ -32,121 +35,567 @@ extern int func_counter;
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int latency_model = 0; /* -l: also estimate cycles with ./csim -l */
+static int attribution = 0; /* -a: per-element hit/miss/eviction maps */
+static int use_cache = 1; /* -n turns the trace and result cache off */
+static int kernels = 0; /* -k: also evaluate the built-in kernels */
+static char *layout_spec = NULL; /* -L: simulate the operands in this layout */
+static layout_t layout;
+
+/* The -k of ./tracegen, when it must register the kernels as well */
+#define KERNEL_FLAG (kernels ? " -k" : "")
+
+/* 
+ * Per-element attribution (-a). A run of ./csim charges every access
+ * inside an operand to its element (--attribute) and writes the counts to
+ * .csim_attrib, which are mapped back to the elements of A and B, or
+ * summed by kernel operand. The results are still those of ./csim-ref,
+ * and the totals of that run of ./csim must match them.
+ */
+struct elem_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions; /* evictions caused by accessing the element */
+};
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
     int funcid;
     int correct;
-    int misses;
+    long long misses;
 };
-static struct results results = {-1, 0, INT_MAX};
+static struct results results = {-1, 0, LLONG_MAX};
 
 /* 
- * eval_perf - Evaluate the performance of the registered transpose functions
+ * traced_address - Where an access of the trace goes in the -L layout
  */
-void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+static unsigned long long traced_address(unsigned long long addr)
+{
+    return layout_spec ? layoutMap(&layout, addr) : addr;
+}
+
+/* 
+ * print_heatmap - ASCII map of the misses of each element of a rows x cols
+ *     matrix: ' ' not accessed, '.' accessed without a miss, '1'-'9' misses,
+ *     '#' ten misses or more
+ */
+static void print_heatmap(const char *name, struct elem_stats *stats, 
+                          int rows, int cols)
+{
+    int i, j;
+
+    printf("%s misses (%dx%d):\n", name, rows, cols);
+    for (i = 0; i < rows; i++) {
+        for (j = 0; j < cols; j++) {
+            struct elem_stats *e = &stats[i * cols + j];
+            if (e->hits + e->misses == 0)
+                putchar(' ');
+            else if (e->misses == 0)
+                putchar('.');
+            else if (e->misses < 10)
+                putchar('0' + e->misses);
+            else
+                putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+/* 
+ * traced_operands - The operands of function i and where they were
+ *     traced: the operands of a kernel, or A (N x M) and B (M x N) at
+ *     a_base and b_base. Returns their number.
+ */
+static int traced_operands(int i, unsigned long long a_base,
+                           unsigned long long b_base, operand_t ops[],
+                           unsigned long base[])
+{
+    operand_t matrices[2] = {{"A", ELEM_INT, OPERAND_IN, N, M},
+                             {"B", ELEM_INT, OPERAND_OUT, M, N}};
+
+    if (func_list[i].kernel) {
+        kernelLayout(func_list[i].kernel, M, N, ops, base);
+        return func_list[i].kernel->num_operands;
+    }
+    memcpy(ops, matrices, sizeof(matrices));
+    base[0] = a_base;
+    base[1] = b_base;
+    return 2;
+}
+
+/* Where operand k is simulated (in the -L layout) and the bytes it takes */
+static unsigned long simulated_base(const operand_t *op, unsigned long base, int k,
+                                    unsigned long *bytes)
+{
+    if (layout_spec) {
+        *bytes = layoutBytes(&layout, op);
+        return layout.new_base[k];
+    }
+    *bytes = (unsigned long)op->rows * op->cols * kernelElemSize(op->type);
+    return base;
+}
+
+/* 
+ * attribute_args - The --attribute options of ./csim for the n operands
+ */
+static void attribute_args(char *args, int n, const operand_t ops[],
+                           const unsigned long base[])
+{
+    unsigned long bytes, sim_base;
+    int k;
+
+    args[0] = '\0';
+    for (k = 0; k < n; k++) {
+        sim_base = simulated_base(&ops[k], base[k], k, &bytes);
+        sprintf(args + strlen(args), " --attribute %s:%lx:%lu:%d", ops[k].name, 
+                sim_base, bytes, kernelElemSize(ops[k].type));
+    }
+}
+
+/* 
+ * read_attribution - Read the counts ./csim wrote to .csim_attrib into
+ *     stats[k], one per element of operand k in row-major order, and the
+ *     accesses outside the operands into *other
+ */
+static void read_attribution(int n, const operand_t ops[], const unsigned long base[],
+                             struct elem_stats *stats[], struct elem_stats *other)
+{
+    struct elem_stats *slots[MAX_OPERANDS], counts;
+    unsigned long bytes, sim_base[MAX_OPERANDS], size[MAX_OPERANDS], num_slots[MAX_OPERANDS];
+    long element, elements;
+    char name[32];
+    int k;
+
+    for (k = 0; k < n; k++) {
+        sim_base[k] = simulated_base(&ops[k], base[k], k, &bytes);
+        size[k] = kernelElemSize(ops[k].type);
+        num_slots[k] = bytes / size[k];
+        slots[k] = calloc(num_slots[k], sizeof(struct elem_stats));
+        stats[k] = calloc((long)ops[k].rows * ops[k].cols, sizeof(struct elem_stats));
+        assert(slots[k] && stats[k]);
+    }
+    memset(other, 0, sizeof(*other));
+
+    /* The elements of the simulated layout */
+    FILE *fp = fopen(".csim_attrib", "r");
+    assert(fp);
+    while (fscanf(fp, "%31s %ld %llu %llu %llu", name, &element, &counts.hits,
+                  &counts.misses, &counts.evictions) == 5) {
+        if (strcmp(name, "other") == 0)
+            *other = counts;
+        for (k = 0; k < n; k++)
+            if (strcmp(name, ops[k].name) == 0 && element >= 0 &&
+                (unsigned long)element < num_slots[k])
+                slots[k][element] = counts;
+    }
+    fclose(fp);
+
+    /* Back to the traced elements */
+    for (k = 0; k < n; k++) {
+        elements = (long)ops[k].rows * ops[k].cols;
+        for (element = 0; element < elements; element++)
+            stats[k][element] = slots[k][(traced_address(base[k] + element * size[k]) - 
+                                          sim_base[k]) / size[k]];
+        free(slots[k]);
+    }
+}
+
+/* 
+ * attribute_trace - Print the heatmaps of A (N x M) and B (M x N) and
+ *     write their per-element counts to attrib.f<i>.csv
+ */
+static void attribute_trace(int i, const operand_t ops[], struct elem_stats *stats[])
+{
+    char filename[128];
+    int k, r, c;
+
+    sprintf(filename, "attrib.f%d.csv", i);
+    FILE *csv_fp = fopen(filename, "w");
+    assert(csv_fp);
+    fprintf(csv_fp, "matrix,row,col,hits,misses,evictions\n");
+    for (k = 0; k < 2; k++)
+        for (r = 0; r < ops[k].rows; r++)
+            for (c = 0; c < ops[k].cols; c++) {
+                struct elem_stats *e = &stats[k][r * ops[k].cols + c];
+                fprintf(csv_fp, "%s,%d,%d,%llu,%llu,%llu\n", ops[k].name, r, c,
+                        e->hits, e->misses, e->evictions);
+            }
+    fclose(csv_fp);
+
+    for (k = 0; k < 2; k++)
+        print_heatmap(ops[k].name, stats[k], ops[k].rows, ops[k].cols);
+    printf("Per-element counts written to %s\n", filename);
+}
+
+/* 
+ * attribute_operands - Print the hits, misses and evictions of each
+ *     operand of a kernel
+ */
+static void attribute_operands(int n, const operand_t ops[], struct elem_stats *stats[],
+                               const struct elem_stats *other)
 {
-    int i,flag;
-    unsigned int len, hits, misses, evictions;
+    struct elem_stats total;
+    long element;
+    int k;
+
+    printf("%-8s%-8s%10s%10s%10s%10s\n", "Operand", "Shape", "Elem size", 
+           "Hits", "Misses", "Evictions");
+    for (k = 0; k <= n; k++) {
+        char shape[32] = "";
+        total = k < n ? (struct elem_stats){0, 0, 0} : *other;
+        if (k < n) {
+            sprintf(shape, "%dx%d", ops[k].rows, ops[k].cols);
+            for (element = 0; element < (long)ops[k].rows * ops[k].cols; element++) {
+                total.hits += stats[k][element].hits;
+                total.misses += stats[k][element].misses;
+                total.evictions += stats[k][element].evictions;
+            }
+        }
+        printf("%-8s%-8s%10d%10llu%10llu%10llu\n", 
+               k < n ? ops[k].name : "other", shape,
+               k < n ? kernelElemSize(ops[k].type) : 0,
+               total.hits, total.misses, total.evictions);
+    }
+}
+
+/* 
+ * Content-addressed cache of the traces and results (turned off by -n).
+ * A trace is keyed by the hash of its function's machine code (tracegen
+ * -H), the matrix size and the addresses of A and B, a result by the key
+ * of its trace, the cache geometry and the simulator binary. A function
+ * is traced again when its code, the code of a registered function it
+ * calls or the placement of its code changed (not that of the stack);
+ * traces are kept gzip-compressed. Functions that fail validation are
+ * never cached.
+ */
+#define CACHE_DIR ".trans-cache"
+
+/* Path of the cache entry of key with the given extension */
+static void cache_path(char *path, unsigned long long key, const char *ext)
+{
+    sprintf(path, CACHE_DIR "/%016llx.%s", key, ext);
+}
+
+/* Hash of a file's contents, 0 if it cannot be read */
+static unsigned long long file_hash(const char *filename)
+{
+    unsigned char buf[65536];
+    unsigned long long hash = HASH_SEED;
+    size_t n;
+    FILE *fp = fopen(filename, "rb");
+
+    if (fp == NULL)
+        return 0;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        hash = hashBytes(buf, n, hash);
+    fclose(fp);
+    return hash;
+}
+
+/* 
+ * read_code_hashes - Get the code hash of every function and the bases of
+ *     A and B from tracegen -H. Returns 0 on success.
+ */
+static int read_code_hashes(unsigned long long code_hash[], 
+                            unsigned long long *a_base,
+                            unsigned long long *b_base)
+{
+    char cmd[255];
+    unsigned long long hash;
+    int i, n = 0;
+
+    mkdir(CACHE_DIR, 0777);
+    sprintf(cmd, "./tracegen -M %d -N %d%s -H > .hashes", M, N, KERNEL_FLAG);
+    if (system(cmd) != 0)
+        return -1;
+    FILE *fp = fopen(".hashes", "r");
+    if (fp == NULL)
+        return -1;
+    while (fscanf(fp, "%d %llx", &i, &hash) == 2 && i >= 0 && i < MAX_TRANS_FUNCS) {
+        code_hash[i] = hash;
+        n++;
+    }
+    fclose(fp);
+    unlink(".hashes");
+    fp = fopen(".marker", "r");
+    if (fp == NULL)
+        return -1;
+    if (fscanf(fp, "%*x %*x %llx %llx", a_base, b_base) != 2)
+        n = 0;
+    fclose(fp);
+    return n == func_counter ? 0 : -1;
+}
+
+/* 
+ * generate_trace - Validate function i and write its filtered trace to
+ *     trace.f<i>. Returns 0 on success, nonzero if it failed validation.
+ */
+static int generate_trace(int i, unsigned long long *a_base, 
+                          unsigned long long *b_base)
+{
+    int flag;
+    unsigned int len;
     unsigned long long int marker_start, marker_end, addr;
     char buf[1000], cmd[255];
     char filename[128];
+    FILE* full_trace_fp;  
+    FILE* part_trace_fp; 
+
+    /* Use valgrind to generate the trace */
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d%s -F %d  > trace.tmp", M, N, KERNEL_FLAG, i);
+    int status_code = system(cmd);
+    flag=WEXITSTATUS(status_code);
+    if (0!=flag) {
+        printf("Validation error at function %d! Run ./tracegen -M %d -N %d%s -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,KERNEL_FLAG,i);      
+        return flag;
+    }
+
+    /* Get the start and end marker addresses */
+    FILE* marker_fp = fopen(".marker", "r");
+    assert(marker_fp);
+    fscanf(marker_fp, "%llx %llx %llx %llx", 
+           &marker_start, &marker_end, a_base, b_base);
+    fclose(marker_fp);
+
+    full_trace_fp = fopen("trace.tmp", "r");
+    assert(full_trace_fp);
+
+    /* Filtered trace for each transpose function goes in a separate file */
+    sprintf(filename, "trace.f%d", i);
+    part_trace_fp = fopen(filename, "w");
+    assert(part_trace_fp);
+    
+    /* Locate trace corresponding to the trans function */
+    flag = 0;
+    while (fgets(buf, 1000, full_trace_fp) != NULL) {
+
+        /* We are only interested in memory access instructions */
+        if (buf[0]==' ' && buf[2]==' ' &&
+            (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
+            sscanf(buf+3, "%llx,%u", &addr, &len);
+        
+            /* If start marker found, set flag */
+            if (addr == marker_start)
+                flag = 1;
+
+            /* Valgrind creates many spurious accesses to the
+               stack that have nothing to do with the students
+               code. At the moment, we are ignoring all stack
+               accesses by using the simple filter of recording
+               accesses to only the low 32-bit portion of the
+               address space. At some point it would be nice to
+               try to do more informed filtering so that would
+               eliminate the valgrind stack references while
+               include the student stack references. */
+            if (flag && addr < 0xffffffff) {
+                fputs(buf, part_trace_fp);
+            }
+
+            /* if end marker found, stop */
+            if (addr == marker_end)
+                break;
+        }
+    }
+    fclose(part_trace_fp);
+    fclose(full_trace_fp);
+    return 0;
+}
+
+/* 
+ * place_operands - Place the operands of function i in the -L layout:
+ *     the operands of a kernel, or A (N x M) and B (M x N) traced at
+ *     a_base and b_base
+ */
+static void place_operands(int i, unsigned long long a_base, 
+                           unsigned long long b_base)
+{
+    operand_t ops[MAX_OPERANDS];
+    unsigned long base[MAX_OPERANDS];
+    int k, n = traced_operands(i, a_base, b_base, ops, base);
+
+    layoutPlace(&layout, n, ops, base);
+    printf("Layout %s:", layout_spec);
+    for (k = 0; k < n; k++)
+        printf(" %s at %#lx (%lu bytes)", ops[k].name, layout.new_base[k], 
+               layoutBytes(&layout, &ops[k]));
+    printf("\n");
+}
+
+/* 
+ * relayout_trace - Write trace.l<i>, trace.f<i> with the addresses of
+ *     the -L layout
+ */
+static void relayout_trace(int i)
+{
+    unsigned long long addr;
+    unsigned int len;
+    char buf[1000], filename[128], op;
+
+    sprintf(filename, "trace.f%d", i);
+    FILE *in_fp = fopen(filename, "r");
+    assert(in_fp);
+    sprintf(filename, "trace.l%d", i);
+    FILE *out_fp = fopen(filename, "w");
+    assert(out_fp);
+    while (fgets(buf, 1000, in_fp) != NULL) {
+        if (sscanf(buf, " %c %llx,%u", &op, &addr, &len) != 3)
+            continue;
+        fprintf(out_fp, " %c %llx,%u\n", op, traced_address(addr), len);
+    }
+    fclose(out_fp);
+    fclose(in_fp);
+}
+
+/* 
+ * eval_perf - Evaluate the performance of the registered transpose functions
+ */
+void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, k, num_operands = 0;
+    operand_t ops[MAX_OPERANDS];
+    unsigned long base[MAX_OPERANDS];
+    struct elem_stats *stats[MAX_OPERANDS], other;
+    char args[256];
+    unsigned long long hits, misses, evictions;
+    unsigned long long int a_base = 0, b_base = 0;
+    unsigned long long code_hash[MAX_TRANS_FUNCS];
+    unsigned long long trace_key = 0, result_key = 0, timing_key = 0;
+    unsigned long long ref_hash = 0, csim_hash = 0;
+    char cmd[512], path[64], trace[32];
+    FILE* in_fp;
+    FILE* cache_fp;
 
     registerFunctions(); 
+    if (kernels)
+        registerKernels();
 
-    /* Open the complete trace file */
-    FILE* full_trace_fp;  
-    FILE* part_trace_fp; 
+    if (use_cache && read_code_hashes(code_hash, &a_base, &b_base) != 0) {
+        printf("Warning: no code hashes from ./tracegen -H, not using the cache\n");
+        use_cache = 0;
+    }
+    if (use_cache) {
+        ref_hash = file_hash("./csim-ref");
+        csim_hash = file_hash("./csim");
+    }
 
     /* Evaluate the performance of each registered transpose function */
 
     for (i=0; i<func_counter; i++) {
+        int have_result = 0, have_timing = 0, have_trace = 0;
+
         if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
             results.funcid = i; /* remember which function is the submission */
 
-
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
-
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-	int status_code = system(cmd);
-        flag=WEXITSTATUS(status_code);
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
-            continue;
+        printf("\nFunction %d (%d total)\n",i,func_counter);
+
+        if (use_cache) {
+            unsigned long long key[5] = {code_hash[i], M, N, a_base, b_base};
+            trace_key = hashBytes(key, sizeof(key), HASH_SEED);
+            unsigned long long sim[5] = {trace_key, s, E, b, ref_hash};
+            result_key = hashBytes(sim, sizeof(sim), HASH_SEED);
+            if (layout_spec)
+                result_key = hashBytes(layout_spec, strlen(layout_spec), result_key);
+            sim[4] = csim_hash;
+            timing_key = hashBytes(sim, sizeof(sim), HASH_SEED);
+            if (layout_spec)
+                timing_key = hashBytes(layout_spec, strlen(layout_spec), timing_key);
+
+            cache_path(path, result_key, "result");
+            if ((cache_fp = fopen(path, "r")) != NULL) {
+                have_result = fscanf(cache_fp, "%llu %llu %llu", 
+                                     &hits, &misses, &evictions) == 3;
+                fclose(cache_fp);
+            }
+            cache_path(path, timing_key, "timing");
+            if (latency_model && (cache_fp = fopen(path, "r")) != NULL) {
+                have_timing = fscanf(cache_fp, "%llu %lf", &func_list[i].num_cycles, 
+                                     &func_list[i].amat) == 2;
+                fclose(cache_fp);
+            }
         }
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
+        /* The trace is needed by whatever is not cached */
+        if (!have_result || attribution || (latency_model && !have_timing)) {
+            cache_path(path, trace_key, "trace.gz");
+            if (use_cache && access(path, R_OK) == 0) {
+                printf("Step 1: Using the cached trace %s\n", path);
+                sprintf(cmd, "gzip -dc %s > trace.f%d", path, i);
+                have_trace = system(cmd) == 0;
+            }
+            if (!have_trace) {
+                printf("Step 1: Validating and generating memory traces\n");
+                if (generate_trace(i, &a_base, &b_base) != 0)
+                    continue;
+                if (use_cache) {
+                    sprintf(cmd, "gzip -c trace.f%d > %s.tmp && mv %s.tmp %s", 
+                            i, path, path, path);
+                    system(cmd);
+                }
+            }
+        }
+        else {
+            printf("Step 1: Using the cached results (%016llx)\n", result_key);
+        }
 
         func_list[i].correct=1;
 
+        /* The simulators read the trace in the -L layout */
+        sprintf(trace, "trace.f%d", i);
+        if (layout_spec) {
+            place_operands(i, a_base, b_base);
+            sprintf(trace, "trace.l%d", i);
+            if (!have_result || attribution || (latency_model && !have_timing))
+                relayout_trace(i);
+        }
+
         /* Save the correctness of the transpose submission */
         if (results.funcid == i ) {
             results.correct = 1;
         }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
+        if (!have_result) {
+            /* Run the reference simulator */
+            printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+            sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t %s > /dev/null", 
+                    s, E, b, trace);
+            system(cmd);
     
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
+            /* Collect results from the reference simulator */
+            in_fp = fopen(".csim_results","r");
+            assert(in_fp);
+            fscanf(in_fp, "%llu %llu %llu", &hits, &misses, &evictions);
+            fclose(in_fp);
+
+            cache_path(path, result_key, "result");
+            if (use_cache && (cache_fp = fopen(path, "w")) != NULL) {
+                fprintf(cache_fp, "%llu %llu %llu\n", hits, misses, evictions);
+                fclose(cache_fp);
+            }
+        }
 
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
+        if (attribution) {
+            /* The counts of each element come from ./csim, with the latency
+               model when its timing is not cached. The results stay those
+               of ./csim-ref, which ./csim must agree with. */
+            unsigned long long csim_hits = 0, csim_misses = 0, csim_evictions = 0;
+            num_operands = traced_operands(i, a_base, b_base, ops, base);
+            attribute_args(args, num_operands, ops, base);
+            printf("Step 2: Attributing the accesses to elements with ./csim\n");
+            sprintf(cmd, "./csim%s -s %u -E %u -b %u -t %s%s > /dev/null", 
+                    latency_model && !have_timing ? " -l" : "", s, E, b, trace, args);
+            system(cmd);
+            in_fp = fopen(".csim_results","r");
+            assert(in_fp);
+            fscanf(in_fp, "%llu %llu %llu", &csim_hits, &csim_misses, &csim_evictions);
+            fclose(in_fp);
+            if (csim_hits != hits || csim_misses != misses || csim_evictions != evictions) {
+                printf("Error: ./csim counts hits:%llu, misses:%llu, evictions:%llu for "
+                       "func %d, ./csim-ref hits:%llu, misses:%llu, evictions:%llu; "
+                       "fix ./csim before using -a\n", csim_hits, csim_misses, csim_evictions,
+                       i, hits, misses, evictions);
+                exit(1);
             }
         }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
 
 	/* 
 	 * -3 because the way markers work now 3 misses are
@@ -160,8 +609,47 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 
 	
         func_list[i].num_evictions = evictions;
-        printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
+        printf("func %u (%s): hits:%llu, misses:%llu, evictions:%llu\n",
                i, func_list[i].description, hits, misses, evictions);
+
+        if (attribution) {
+            read_attribution(num_operands, ops, base, stats, &other);
+            if (func_list[i].kernel)
+                attribute_operands(num_operands, ops, stats, &other);
+            else
+                attribute_trace(i, ops, stats);
+            for (k = 0; k < num_operands; k++)
+                free(stats[k]);
+        }
+
+        /* Estimate the run time with the latency model of ./csim, which
+           puts its timing on the second line of .csim_results (the run
+           of the attribution already did) */
+        if (latency_model && !have_timing) {
+            if (!attribution) {
+                sprintf(cmd, "./csim -l -s %u -E %u -b %u -t %s > /dev/null", 
+                        s, E, b, trace);
+                system(cmd);
+            }
+            in_fp = fopen(".csim_results","r");
+            assert(in_fp);
+            if (fscanf(in_fp, "%*d %*d %*d %*d %*d %*d %llu %lf",
+                       &func_list[i].num_cycles, &func_list[i].amat) != 2)
+                printf("Error: ./csim did not report a latency model\n");
+            else if (use_cache) {
+                cache_path(path, timing_key, "timing");
+                if ((cache_fp = fopen(path, "w")) != NULL) {
+                    fprintf(cache_fp, "%llu %.17g\n", func_list[i].num_cycles, 
+                            func_list[i].amat);
+                    fclose(cache_fp);
+                }
+            }
+            fclose(in_fp);
+        }
+        if (latency_model)
+            printf("func %u (%s): est. cycles:%llu, amat:%.2f\n",
+                   i, func_list[i].description, 
+                   func_list[i].num_cycles, func_list[i].amat);
     
         /* If it is transpose_submit(), record number of misses */
         if (results.funcid == i) {
@@ -171,13 +659,46 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
   
 }
 
+/*
+ * print_ranking - Print the correct functions ordered by estimated cycles
+ */
+void print_ranking()
+{
+    int order[MAX_TRANS_FUNCS];
+    int i, j, n = 0;
+
+    for (i = 0; i < func_counter; i++) {
+        if (!func_list[i].correct)
+            continue;
+        /* insertion sort, there are only a handful of functions */
+        for (j = n; j > 0 && 
+                 func_list[order[j-1]].num_cycles > func_list[i].num_cycles; j--)
+            order[j] = order[j-1];
+        order[j] = i;
+        n++;
+    }
+    printf("\nFunctions ranked by estimated cycles:\n");
+    for (j = 0; j < n; j++)
+        printf("%2d. func %d (%s): cycles:%llu, amat:%.2f, misses:%llu\n",
+               j + 1, order[j], func_list[order[j]].description,
+               func_list[order[j]].num_cycles, func_list[order[j]].amat,
+               func_list[order[j]].num_misses);
+}
+
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-ahkln] [-L <layout>] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
+    printf("  -a          Map hits, misses and evictions to matrix elements\n");
     printf("  -h          Print this help message.\n");
+    printf("  -k          Also evaluate the built-in kernels of kernels.c\n");
+    printf("  -l          Rank functions by cycles estimated with ./csim -l\n");
+    printf("  -n          Do not use the cached traces and results (%s)\n", CACHE_DIR);
+    printf("  -L <layout> Simulate A and B (or the kernel operands) in another layout:\n");
+    printf("              row, tiled:<tile> or morton, then ,pad=<elems>, ,align=<bytes>\n");
+    printf("              and ,offset=<bytes> (e.g. row,pad=8 or tiled:8,offset=32)\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
@@ -210,7 +731,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:L:ahkln")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -218,6 +739,26 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'a':
+            attribution = 1;
+            break;
+        case 'k':
+            kernels = 1;
+            break;
+        case 'l':
+            latency_model = 1;
+            break;
+        case 'n':
+            use_cache = 0;
+            break;
+        case 'L':
+            layout_spec = optarg;
+            if (layoutParse(&layout, layout_spec) != 0) {
+                printf("Error: invalid layout \"%s\"\n", layout_spec);
+                usage(argv);
+                exit(1);
+            }
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -255,6 +796,8 @@ int main(int argc, char* argv[])
 
     /* Check the performance of the student's transpose function */
     eval_perf(5, 1, 5);
+    if (latency_model)
+        print_ranking();
   
     /* Emit the results for this particular test */
     if (results.funcid == -1) {
@@ -264,9 +807,9 @@ int main(int argc, char* argv[])
         printf("\nTEST_TRANS_RESULTS=0:0\n");
     }
     else {
-        printf("\nSummary for official submission (func %d): correctness=%d misses=%d\n",
+        printf("\nSummary for official submission (func %d): correctness=%d misses=%lld\n",
                results.funcid, results.correct, results.misses);
-        printf("\nTEST_TRANS_RESULTS=%d:%d\n", results.correct, results.misses);
+        printf("\nTEST_TRANS_RESULTS=%d:%lld\n", results.correct, results.misses);
     }
     return 0;
 }
@@ -0,0 +1,155 @@
+/*
+ * tlb.c - A multi-level TLB and x86-64 page-walk model for the cache simulator.
+ *
+ * Every level is set associative with LRU replacement and holds entries of
+ * any page size; an entry is tagged with its page size. The levels are
+ * inclusive: a translation found in level i is filled into the levels above.
+ * The page size of an address comes from the page ranges given on the
+ * command line, so huge-page policies can be compared on the same trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tlb.h"
+
+/* 
+ * The page tables live in a synthetic region in the upper (kernel) half
+ * of the address space, above the user addresses of any trace (below
+ * 2^47), one 1TB slice per level. A walk only uses the 48 bits of the
+ * address a 4-level table translates, so every entry stays inside its
+ * slice. Entries of neighbouring pages are adjacent, so a walk enjoys
+ * the same spatial locality as on hardware.
+ */
+#define PAGE_TABLE_BASE 0xffff800000000000UL
+#define VIRTUAL_ADDRESS_MASK ((1UL << 48) - 1)
+#define PAGE_TABLE_ENTRY_SIZE 8
+
+int tlb_parse_page_size(const char *str)
+{
+    if (strcmp(str, "4k") == 0 || strcmp(str, "4K") == 0)
+        return PAGE_SHIFT_4K;
+    if (strcmp(str, "2m") == 0 || strcmp(str, "2M") == 0)
+        return PAGE_SHIFT_2M;
+    if (strcmp(str, "1g") == 0 || strcmp(str, "1G") == 0)
+        return PAGE_SHIFT_1G;
+    return -1;
+}
+
+int tlb_configure(struct TLB *tlb, const char *spec)
+{
+    int entries, ways, used;
+
+    tlb->levels = 0;
+    while (*spec) {
+        if (tlb->levels == TLB_MAX_LEVELS ||
+            sscanf(spec, "%d:%d%n", &entries, &ways, &used) != 2 ||
+            ways <= 0 || entries < ways || entries % ways != 0)
+            return -1;
+        struct TLBLevel *level = &tlb->level[tlb->levels++];
+        level->sets = entries / ways;
+        level->ways = ways;
+        level->entries = calloc(entries, sizeof(struct TLBEntry));
+        level->hits = 0;
+        level->misses = 0;
+        spec += used;
+        if (*spec == ',')
+            spec++;
+    }
+    return tlb->levels > 0 ? 0 : -1;
+}
+
+int tlb_add_page_range(struct TLB *tlb, const char *spec)
+{
+    unsigned long start, end;
+    char size[8];
+
+    if (tlb->ranges == TLB_MAX_PAGE_RANGES ||
+        sscanf(spec, "%lx-%lx=%7s", &start, &end, size) != 3)
+        return -1;
+    int page_shift = tlb_parse_page_size(size);
+    if (page_shift < 0 || end <= start)
+        return -1;
+    tlb->range[tlb->ranges].start = start;
+    tlb->range[tlb->ranges].end = end;
+    tlb->range[tlb->ranges].page_shift = page_shift;
+    tlb->ranges++;
+    return 0;
+}
+
+/* page_shift_of - Page size used for address, the first matching range wins */
+static int page_shift_of(struct TLB *tlb, unsigned long address)
+{
+    for (int i = 0; i < tlb->ranges; i++)
+        if (address >= tlb->range[i].start && address < tlb->range[i].end)
+            return tlb->range[i].page_shift;
+    return tlb->page_shift;
+}
+
+/* 
+ * level_access - Look a page up in one level. On a miss, the LRU way of
+ *     its set is replaced by the page. Returns 1 on a hit.
+ */
+static int level_access(struct TLB *tlb, struct TLBLevel *level,
+                        unsigned long vpn, int page_shift)
+{
+    struct TLBEntry *set = &level->entries[(vpn % level->sets) * level->ways];
+    struct TLBEntry *lru = &set[0];
+
+    for (int i = 0; i < level->ways; i++) {
+        if (set[i].valid && set[i].vpn == vpn && set[i].page_shift == page_shift) {
+            set[i].last_used = tlb->clock;
+            level->hits++;
+            return 1;
+        }
+        if (!set[i].valid || (lru->valid && set[i].last_used < lru->last_used))
+            lru = &set[i];
+    }
+    level->misses++;
+    lru->valid = 1;
+    lru->vpn = vpn;
+    lru->page_shift = page_shift;
+    lru->last_used = tlb->clock;
+    return 0;
+}
+
+int tlb_translate(struct TLB *tlb, unsigned long address,
+                  unsigned long walk[TLB_MAX_WALK])
+{
+    int page_shift = page_shift_of(tlb, address);
+    unsigned long vpn = address >> page_shift;
+
+    tlb->clock++;
+    for (int i = 0; i < tlb->levels; i++)
+        if (level_access(tlb, &tlb->level[i], vpn, page_shift))
+            return 0;
+
+    /* Walk from the root (PML4, 39) down to the level that maps the page */
+    int n = 0;
+    for (int shift = 39; shift >= page_shift; shift -= 9) {
+        int table = (39 - shift) / 9;
+        walk[n++] = PAGE_TABLE_BASE + ((unsigned long)table << 40) +
+            ((address & VIRTUAL_ADDRESS_MASK) >> shift) * PAGE_TABLE_ENTRY_SIZE;
+    }
+    tlb->walks++;
+    tlb->walk_accesses += n;
+    return n;
+}
+
+void tlb_print_summary(struct TLB *tlb)
+{
+    for (int i = 0; i < tlb->levels; i++)
+        printf("tlb_l%d_hits:%llu tlb_l%d_misses:%llu ",
+               i + 1, tlb->level[i].hits, i + 1, tlb->level[i].misses);
+    printf("page_walks:%llu walk_accesses:%llu", tlb->walks, tlb->walk_accesses);
+    if (tlb->inject_walks)
+        printf(" walk_hits:%llu walk_misses:%llu walk_evictions:%llu",
+               tlb->walk_hits, tlb->walk_misses, tlb->walk_evictions);
+    printf("\n");
+}
+
+void tlb_free(struct TLB *tlb)
+{
+    for (int i = 0; i < tlb->levels; i++)
+        free(tlb->level[i].entries);
+    tlb->levels = 0;
+}
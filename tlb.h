@@ -0,0 +1,85 @@
+/* 
+ * tlb.h - Prototypes for the TLB and page-walk model of the cache simulator
+ */
+
+#ifndef CSIM_TLB_H
+#define CSIM_TLB_H
+
+#define TLB_MAX_LEVELS 4
+#define TLB_MAX_PAGE_RANGES 16
+#define TLB_MAX_WALK 4 /* x86-64 four-level page table */
+
+#define PAGE_SHIFT_4K 12
+#define PAGE_SHIFT_2M 21
+#define PAGE_SHIFT_1G 30
+
+/* One translation, tagged with the page size it maps */
+struct TLBEntry {
+    unsigned long vpn;  /* virtual page number */
+    int page_shift;
+    int valid;
+    unsigned long last_used; /* LRU timestamp */
+};
+
+/* One set-associative TLB level */
+struct TLBLevel {
+    int sets;
+    int ways;
+    struct TLBEntry *entries; /* sets * ways entries, set-major */
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+/* Addresses in [start, end) are mapped with pages of 1 << page_shift bytes */
+struct PageRange {
+    unsigned long start;
+    unsigned long end;
+    int page_shift;
+};
+
+struct TLB {
+    int levels;
+    struct TLBLevel level[TLB_MAX_LEVELS];
+    int page_shift; /* page size of addresses outside every range */
+    int ranges;
+    struct PageRange range[TLB_MAX_PAGE_RANGES];
+    int inject_walks; /* page-walk loads also go through the data cache */
+    unsigned long clock;
+    unsigned long long walks;
+    unsigned long long walk_accesses;
+    /* outcomes of the page-walk loads in the data cache, with inject_walks */
+    unsigned long long walk_hits;
+    unsigned long long walk_misses;
+    unsigned long long walk_evictions;
+};
+
+/* Parse a page size ("4k", "2m" or "1g") into its shift, -1 if invalid */
+int tlb_parse_page_size(const char *str);
+
+/* 
+ * tlb_configure - Set up the levels from "<entries>:<ways>[,<entries>:<ways>...]",
+ *     first level first. Returns 0 on success, -1 on a malformed spec.
+ */
+int tlb_configure(struct TLB *tlb, const char *spec);
+
+/* Map "<start>-<end>=<size>" (hex addresses) with the given page size */
+int tlb_add_page_range(struct TLB *tlb, const char *spec);
+
+/* 
+ * tlb_translate - Look the page of address up in every level, filling the
+ *     levels that missed. On a miss in all of them, the addresses of the
+ *     page-table entries read by the walk are stored in walk[] (at most
+ *     TLB_MAX_WALK) and their number is returned; a hit returns 0.
+ */
+int tlb_translate(struct TLB *tlb, unsigned long address, 
+                  unsigned long walk[TLB_MAX_WALK]);
+
+/*
+ * Print the per-level hit and miss counts and the page walks, and what the
+ *     page-walk loads did in the data cache when they go through it
+ */
+void tlb_print_summary(struct TLB *tlb);
+
+void tlb_free(struct TLB *tlb);
+
+#endif /* CSIM_TLB_H */
@@ -4,15 +4,26 @@
  * 
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use, followed by the base
+ * addresses of A and B so that accesses can be mapped back to elements.
+ *
+ * With -k the built-in kernels of kernels.c are registered after the
+ * transpose functions. Their operands are allocated in the kernel arena
+ * instead of A and B, and checked against the kernel's reference.
+ *
+ * With -H it prints a hash of the machine code of every registered
+ * function instead of running them, the key test-trans caches its
+ * traces and results under.
  */
 
+#define _POSIX_C_SOURCE 200809L /* popen */
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 #include <unistd.h>
 #include <getopt.h>
 #include "cachelab.h"
+#include "kernels.h"
 #include <string.h>
 
 /* External variables declared in cachelab.c */
@@ -47,12 +58,180 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * owns - Whether the code or data at addr belongs to registered function
+ *     i: a transpose function owns its code, a kernel its descriptor and
+ *     the functions it points to (two kernels may share one)
+ */
+static int owns(int i, unsigned long long addr)
+{
+    const kernel_t *kernel = func_list[i].kernel;
+
+    return (unsigned long long)func_list[i].func_ptr == addr ||
+        (kernel && ((unsigned long long)kernel == addr ||
+                    (unsigned long long)kernel->shape == addr ||
+                    (unsigned long long)kernel->init == addr ||
+                    (unsigned long long)kernel->run == addr ||
+                    (unsigned long long)kernel->reference == addr));
+}
+
+/*
+ * find_calls - Set calls[i][j] if code owned by function i calls or
+ *     jumps to code owned by function j, from the disassembly of self.
+ *     If it can't be disassembled every function is taken to call every
+ *     other one.
+ */
+static void find_calls(const char *self, char calls[][MAX_TRANS_FUNCS])
+{
+    char line[512], cmd[512], name[256], *op;
+    unsigned long long function = 0, target;
+    int i, j;
+
+    sprintf(cmd, "objdump -d --no-show-raw-insn %s", self);
+    FILE *fp = popen(cmd, "r");
+    assert(fp);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%llx <%255[^>]>:", &target, name) == 2) {
+            function = target;
+            continue;
+        }
+        /* "  <addr>:\tcall   <target> <symbol>", or jmp for a tail call */
+        op = strchr(line, '\t');
+        if (op == NULL || (strncmp(op + 1, "call", 4) != 0 && strncmp(op + 1, "jmp", 3) != 0))
+            continue;
+        op += strcspn(op, " ");
+        if (sscanf(op, "%llx", &target) != 1)
+            continue;
+        for (i = 0; i < func_counter; i++)
+            if (owns(i, function))
+                for (j = 0; j < func_counter; j++)
+                    if (j != i && owns(j, target))
+                        calls[i][j] = 1;
+    }
+    if (pclose(fp) != 0)
+        memset(calls, 1, MAX_TRANS_FUNCS * sizeof(calls[0]));
+}
+
+/* 
+ * print_code_hashes - Print "<function> <hash>" for every registered function.
+ *     The hash covers the bytes of the function, of every registered
+ *     function it calls directly or not, and of every other symbol of
+ *     trans.o, trans-parallel.o and kernels.o except the register
+ *     functions and the description strings, which do not change any
+ *     trace: a helper or a global of trans.c changes every hash, an
+ *     edited transpose function its own and those of its callers. Code
+ *     that moves changes too, so a function that grows may change the
+ *     hashes of the functions placed after it. The placement of the stack
+ *     is not part of the hash, although the trace has its accesses. The
+ *     symbols and their sizes come from nm.
+ */
+void print_code_hashes(const char *self)
+{
+    char line[512], name[256], type, cmd[512];
+    unsigned long long addr, size, shared = HASH_SEED;
+    unsigned long long code_hash[MAX_TRANS_FUNCS];
+    static char calls[MAX_TRANS_FUNCS][MAX_TRANS_FUNCS];
+    int i, j, k, names = 0, own = 0;
+    static char trans_names[4096][256];
+
+    for (i = 0; i < func_counter; i++)
+        code_hash[i] = HASH_SEED;
+
+    /* The symbols defined by trans.o, the kernels and the parallel transpose they call */
+    FILE *nm_fp = popen("nm --defined-only trans.o trans-parallel.o kernels.o", "r");
+    assert(nm_fp);
+    while (fgets(line, sizeof(line), nm_fp) != NULL && names < 4096)
+        if (sscanf(line, "%*s %c %255s", &type, name) == 2)
+            strcpy(trans_names[names++], name);
+    pclose(nm_fp);
+
+    /* Their addresses and sizes in this executable, in address order */
+    sprintf(cmd, "nm -S -n --defined-only %s", self);
+    nm_fp = popen(cmd, "r");
+    assert(nm_fp);
+    while (fgets(line, sizeof(line), nm_fp) != NULL) {
+        if (sscanf(line, "%llx %llx %c %255s", &addr, &size, &type, name) != 4)
+            continue;
+        for (k = 0; k < names && strcmp(trans_names[k], name) != 0; k++)
+            ;
+        if (k == names || strcmp(name, "registerFunctions") == 0 ||
+            strcmp(name, "registerKernels") == 0)
+            continue;
+        own = 0;
+        for (i = 0; i < func_counter; i++) {
+            if (owns(i, addr)) {
+                code_hash[i] = hashBytes((void *)addr, size, code_hash[i]);
+                own = 1;
+            }
+            if ((unsigned long long)func_list[i].description == addr)
+                own = 1;
+        }
+        if (!own) {
+            shared = hashBytes(name, strlen(name), shared);
+            shared = hashBytes((void *)addr, size, shared);
+        }
+    }
+    pclose(nm_fp);
+
+    /* The registered functions each one calls, directly or through others */
+    find_calls(self, calls);
+    for (k = 0; k < func_counter; k++)
+        for (i = 0; i < func_counter; i++)
+            if (calls[i][k])
+                for (j = 0; j < func_counter; j++)
+                    calls[i][j] |= calls[k][j];
+
+    for (i = 0; i < func_counter; i++) {
+        unsigned long long hash = hashBytes(&shared, sizeof(shared), code_hash[i]);
+        for (j = 0; j < func_counter; j++)
+            if (j != i && calls[i][j])
+                hash = hashBytes(&code_hash[j], sizeof(code_hash[j]), hash);
+        printf("%d %016llx\n", i, hash);
+    }
+}
+
+/* 
+ * run_kernel - Run kernel fn between the markers on operands in the
+ *     kernel arena, and check its outputs. Returns 1 if they are correct.
+ */
+int run_kernel(int fn, const kernel_t *kernel)
+{
+    void *ptrs[MAX_OPERANDS];
+
+    if (kernelAlloc(kernel, M, N, ptrs) != 0) {
+        printf("Can't map the operands of function %d at %#lx\n", fn, KERNEL_ARENA);
+        return 0;
+    }
+    void **saved = kernelSave(kernel, M, N, ptrs);
+    MARKER_START = 33;
+    kernel->run(M, N, ptrs);
+    MARKER_END = 34;
+    int correct = kernelValidate(fn, kernel, M, N, ptrs, saved);
+    kernelFree(kernel, M, N);
+    return correct;
+}
+
+/* 
+ * run_function - Run function fn between the markers and validate it
+ */
+int run_function(int fn)
+{
+    if (func_list[fn].kernel)
+        return run_kernel(fn, func_list[fn].kernel);
+    MARKER_START = 33;
+    (*func_list[fn].func_ptr)(M, N, A, B);
+    MARKER_END = 34;
+    return validate(fn,M,N,A_TEMP,B);
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int hashes=0;
+    int kernels=0;
+    while( (c=getopt(argc,argv,"M:N:F:Hk")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -63,6 +242,12 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'H':
+            hashes = 1;
+            break;
+        case 'k':
+            kernels = 1;
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -73,6 +258,8 @@ int main(int argc, char* argv[]){
 
     /*  Register transpose functions */
     registerFunctions();
+    if (kernels)
+        registerKernels();
 
     /* Fill A with data */
     initMatrix(M,N, A, B);
@@ -80,28 +267,43 @@ int main(int argc, char* argv[]){
     /* Store initial A values in A_TEMP for correctness check */
     memcpy(A_TEMP, A, M*N*sizeof(A[0][0]));
 
-    /* Record marker addresses */
+    /* Record marker addresses, and the first two operands of a kernel
+       in place of A and B */
+    unsigned long long a_base = (unsigned long long) A;
+    unsigned long long b_base = (unsigned long long) B;
+    if (selectedFunc >= 0 && selectedFunc < func_counter &&
+        func_list[selectedFunc].kernel) {
+        operand_t ops[MAX_OPERANDS];
+        unsigned long base[MAX_OPERANDS];
+        kernelLayout(func_list[selectedFunc].kernel, M, N, ops, base);
+        a_base = base[0];
+        b_base = base[1];
+    }
     FILE* marker_fp = fopen(".marker","w");
     assert(marker_fp);
-    fprintf(marker_fp, "%llx %llx", 
+    fprintf(marker_fp, "%llx %llx %llx %llx", 
             (unsigned long long int) &MARKER_START,
-            (unsigned long long int) &MARKER_END );
+            (unsigned long long int) &MARKER_END,
+            a_base, b_base);
     fclose(marker_fp);
 
+    if (hashes) {
+        print_code_hashes(argv[0]);
+        return 0;
+    }
+
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A_TEMP,B))
+            if (!run_function(i))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A_TEMP,B))
+        if (selectedFunc >= func_counter) {
+            printf("./tracegen has no function %d\n", selectedFunc);
+            return selectedFunc+1;
+        }
+        if (!run_function(selectedFunc))
             return selectedFunc+1;
 
     }
@@ -0,0 +1,331 @@
+/*
+ * trans-parallel.c - Multithreaded cache-blocked transpose.
+ *
+ * The destination B is cut into TRANS_TILE x TRANS_TILE tiles, numbered
+ * row-major so that consecutive tiles are close in B. Worker k starts
+ * with the k-th contiguous run of tiles in its own deque; it takes tiles
+ * from the front of that run, and once it is empty steals the back half
+ * of the run of another worker. Stealing only ever moves tiles between
+ * deques, so a worker that finds every deque empty can stop.
+ *
+ * The caller of a job is worker 0. Workers 1, 2, ... live in a pool: each
+ * is started by the first job that needs it, pinned once to its CPU and
+ * then waits for the next job until the process exits, so a job does not
+ * pay for creating threads. Worker k runs on the k-th CPU the caller may
+ * run on (the caller is pinned to the first one for the job and gets its
+ * own affinity back afterwards). Since the initial runs are the same for
+ * a given number of threads, trans_parallel_alloc first touches every run
+ * of B from the CPU of the worker that will start on it, and the pages end
+ * up on that worker's NUMA node.
+ *
+ * A job on one thread runs the tiles in order on the caller, without the
+ * pool, the locks or the pinning.
+ */
+#define _GNU_SOURCE /* MAP_ANONYMOUS, pthread_setaffinity_np */
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "trans-parallel.h"
+
+/* The remaining tiles [begin, end) of a worker */
+struct deque {
+    pthread_mutex_t lock;
+    long begin, end;
+};
+
+struct job {
+    int M, N;
+    const int *A;
+    int *B;
+    int threads;
+    int touch;          /* first touch B instead of transposing */
+    int stream;         /* the rows of B can be written with 16-byte stores */
+    long tile_cols;     /* tiles in a row of B */
+    long tiles;
+    struct deque *deques;
+};
+
+/* The workers of the pool and the job they run */
+static struct {
+    pthread_mutex_t busy;      /* held by the caller of a job, one job at a time */
+    pthread_mutex_t lock;      /* protects the rest */
+    pthread_cond_t start;      /* a job was posted */
+    pthread_cond_t done;       /* the last worker of the pool finished the job */
+    int workers;               /* started so far, not counting the callers */
+    unsigned long generation;  /* jobs posted so far */
+    struct job *job;           /* the last one posted */
+    int running;               /* workers of the pool still running it */
+    int pinned;                /* the workers are pinned to the CPUs of allowed */
+    cpu_set_t allowed;         /* the CPUs of the caller that started the pool */
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+          PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/*
+ * transpose_tile - Transpose the tile of rows [j0, j1) and columns
+ *     [i0, i1) of B. B is written row by row, so with streaming stores
+ *     every row of a 4-row strip fills whole lines before the next strip.
+ */
+static void transpose_tile(const struct job *job, int j0, int j1, int i0, int i1)
+{
+    const int M = job->M, N = job->N;
+    const int *A = job->A;
+    int *B = job->B;
+    int i, j, j4 = j0, i4 = i0;
+
+#ifdef __SSE2__
+    if (job->stream) {
+        /* full 4x4 blocks, each one four loads of A and four stores of B */
+        i4 = i0 + ((i1 - i0) & ~3);
+        j4 = j0 + ((j1 - j0) & ~3);
+        for (j = j0; j < j4; j += 4) {
+            for (i = i0; i < i4; i += 4) {
+                __m128i r0 = _mm_loadu_si128((const __m128i *)&A[(long)i * M + j]);
+                __m128i r1 = _mm_loadu_si128((const __m128i *)&A[(long)(i + 1) * M + j]);
+                __m128i r2 = _mm_loadu_si128((const __m128i *)&A[(long)(i + 2) * M + j]);
+                __m128i r3 = _mm_loadu_si128((const __m128i *)&A[(long)(i + 3) * M + j]);
+                __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+                __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+                __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+                __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+                _mm_stream_si128((__m128i *)&B[(long)j * N + i], _mm_unpacklo_epi64(t0, t1));
+                _mm_stream_si128((__m128i *)&B[(long)(j + 1) * N + i], _mm_unpackhi_epi64(t0, t1));
+                _mm_stream_si128((__m128i *)&B[(long)(j + 2) * N + i], _mm_unpacklo_epi64(t2, t3));
+                _mm_stream_si128((__m128i *)&B[(long)(j + 3) * N + i], _mm_unpackhi_epi64(t2, t3));
+            }
+            /* the columns right of the last full block */
+            for (; i < i1; i++) {
+                B[(long)j * N + i] = A[(long)i * M + j];
+                B[(long)(j + 1) * N + i] = A[(long)i * M + j + 1];
+                B[(long)(j + 2) * N + i] = A[(long)i * M + j + 2];
+                B[(long)(j + 3) * N + i] = A[(long)i * M + j + 3];
+            }
+        }
+    }
+#endif
+    /* the rows below the last full block, or the whole tile */
+    for (j = j4; j < j1; j++)
+        for (i = i0; i < i1; i++)
+            B[(long)j * N + i] = A[(long)i * M + j];
+}
+
+/* Pin the calling thread, worker id, to the id-th CPU of allowed (wrapping around) */
+static void pin_worker(const cpu_set_t *allowed, int id)
+{
+    int cpu, seen = -1, count = CPU_COUNT(allowed);
+    cpu_set_t set;
+
+    if (count == 0)
+        return;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, allowed) && ++seen == id % count)
+            break;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* Take the next tile of the worker's own run, -1 if it is empty */
+static long pop_tile(struct deque *deque)
+{
+    long tile = -1;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->begin < deque->end)
+        tile = deque->begin++;
+    pthread_mutex_unlock(&deque->lock);
+    return tile;
+}
+
+/* Move the back half of another worker's run to the worker, 0 if there was none */
+static int steal_tiles(struct job *job, int id)
+{
+    struct deque *own = &job->deques[id];
+    int k;
+
+    for (k = 1; k < job->threads; k++) {
+        struct deque *victim = &job->deques[(id + k) % job->threads];
+        long begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->end > victim->begin) {
+            end = victim->end;
+            begin = end - (victim->end - victim->begin + 1) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (end > begin) {
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Transpose, or first touch, one tile of B */
+static void run_tile(const struct job *job, long tile)
+{
+    int j0 = (tile / job->tile_cols) * TRANS_TILE;
+    int i0 = (tile % job->tile_cols) * TRANS_TILE;
+    int j1 = j0 + TRANS_TILE < job->M ? j0 + TRANS_TILE : job->M;
+    int i1 = i0 + TRANS_TILE < job->N ? i0 + TRANS_TILE : job->N;
+
+    if (job->touch) {
+        for (int j = j0; j < j1; j++)
+            memset(&job->B[(long)j * job->N + i0], 0, (i1 - i0) * sizeof(int));
+    } else {
+        transpose_tile(job, j0, j1, i0, i1);
+    }
+}
+
+/* Make the streaming stores of the calling thread visible to the others */
+static void fence_stores(void)
+{
+#ifdef __SSE2__
+    _mm_sfence();
+#endif
+}
+
+static void run_worker(struct job *job, int id)
+{
+    long tile;
+
+    for (;;) {
+        tile = pop_tile(&job->deques[id]);
+        if (tile < 0) {
+            /* first touch follows the initial runs, it never steals */
+            if (job->touch || !steal_tiles(job, id))
+                break;
+            continue;
+        }
+        run_tile(job, tile);
+    }
+    /* an sfence orders only this core's stores, so every worker issues its own */
+    fence_stores();
+}
+
+/*
+ * A worker of the pool. It is started while the job that needs it is
+ * being posted, so the first job it waits for is that one.
+ */
+static void *pool_worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    unsigned long seen;
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.pinned)
+        pin_worker(&pool.allowed, id);
+    seen = pool.generation - 1;
+    for (;;) {
+        while (pool.generation == seen)
+            pthread_cond_wait(&pool.start, &pool.lock);
+        seen = pool.generation;
+        struct job *job = pool.job;
+        if (id >= job->threads)
+            continue;
+        pthread_mutex_unlock(&pool.lock);
+        run_worker(job, id);
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.running == 0)
+            pthread_cond_signal(&pool.done);
+    }
+    return NULL;
+}
+
+/* Split the tiles of B over the workers and run them, the caller is worker 0 */
+static void run_job(int M, int N, const int *A, int *B, int threads, int touch)
+{
+    struct job job;
+    cpu_set_t allowed;
+    int k, pinned;
+
+    job.M = M;
+    job.N = N;
+    job.A = A;
+    job.B = B;
+    job.touch = touch;
+    job.stream = N % 4 == 0 && (uintptr_t)B % 16 == 0;
+    job.tile_cols = (N + TRANS_TILE - 1) / TRANS_TILE;
+    job.tiles = job.tile_cols * ((M + TRANS_TILE - 1) / TRANS_TILE);
+    if (threads == 1) {
+        for (long tile = 0; tile < job.tiles; tile++)
+            run_tile(&job, tile);
+        fence_stores();
+        return;
+    }
+
+    pthread_mutex_lock(&pool.busy);
+    pinned = pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) == 0;
+    pthread_mutex_lock(&pool.lock);
+    if (pool.workers == 0) {
+        pool.pinned = pinned;
+        pool.allowed = allowed;
+    }
+    while (pool.workers < threads - 1) {
+        pthread_t id;
+        if (pthread_create(&id, NULL, pool_worker, (void *)(intptr_t)(pool.workers + 1)) != 0)
+            break;
+        pthread_detach(id);
+        pool.workers++;
+    }
+    /* with fewer workers than asked for, the ones there are steal the rest */
+    if (threads > pool.workers + 1)
+        threads = pool.workers + 1;
+
+    struct deque deques[threads];
+    job.threads = threads;
+    job.deques = deques;
+    for (k = 0; k < threads; k++) {
+        pthread_mutex_init(&deques[k].lock, NULL);
+        deques[k].begin = job.tiles * k / threads;
+        deques[k].end = job.tiles * (k + 1) / threads;
+    }
+    pool.job = &job;
+    pool.running = threads - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    if (pinned)
+        pin_worker(&allowed, 0);
+    run_worker(&job, 0);
+    pthread_mutex_lock(&pool.lock);
+    while (pool.running > 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+    if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+    for (k = 0; k < threads; k++)
+        pthread_mutex_destroy(&deques[k].lock);
+    pthread_mutex_unlock(&pool.busy);
+}
+
+void trans_parallel(int M, int N, const int *A, int *B, int threads)
+{
+    run_job(M, N, A, B, threads > 0 ? threads : 1, 0);
+}
+
+int *trans_parallel_alloc(int M, int N, int threads)
+{
+    size_t bytes = (size_t)M * N * sizeof(int);
+    void *B = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (B == MAP_FAILED)
+        return NULL;
+    run_job(M, N, NULL, B, threads > 0 ? threads : 1, 1);
+    return B;
+}
+
+void trans_parallel_free(int *B, int M, int N)
+{
+    munmap(B, (size_t)M * N * sizeof(int));
+}
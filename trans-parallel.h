@@ -0,0 +1,34 @@
+/*
+ * trans-parallel.h - Multithreaded cache-blocked transpose for large matrices
+ */
+
+#ifndef TRANS_PARALLEL_H
+#define TRANS_PARALLEL_H
+
+/* Side of a square tile, in ints: a tile of A and one of B fit in L1 */
+#define TRANS_TILE 64
+
+/*
+ * trans_parallel - B = A^T, where A is N x M and B is M x N, both stored
+ *     row-major. The tiles of B are split over "threads" workers (the
+ *     calling thread is one of them), each starting with a contiguous run
+ *     of tiles and stealing half of another worker's remaining run when it
+ *     runs out. The other workers come from a pool that keeps them between
+ *     calls; worker k runs on the k-th CPU the caller may run on. Rows of
+ *     B are written with non-temporal stores when the target supports
+ *     them (SSE2) and they are 16-byte aligned. With one thread the tiles
+ *     are transposed in order by the caller alone.
+ */
+void trans_parallel(int M, int N, const int *A, int *B, int threads);
+
+/*
+ * trans_parallel_alloc - Allocate an M x N destination matrix whose pages
+ *     are first touched by the worker that trans_parallel(..., threads)
+ *     starts on them, on the same CPU, so on a NUMA machine each part of B
+ *     is placed on the node of the thread that writes it, as long as the
+ *     caller's CPU affinity stays the same. Free with trans_parallel_free.
+ */
+int *trans_parallel_alloc(int M, int N, int threads);
+void trans_parallel_free(int *B, int M, int N);
+
+#endif /* TRANS_PARALLEL_H */